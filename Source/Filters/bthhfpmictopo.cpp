@@ -0,0 +1,118 @@
+/*++
+
+Copyright (c) Microsoft Corporation All Rights Reserved
+
+Module Name:
+
+    bthhfpmictopo.cpp
+
+Abstract:
+
+    Implementation of topology miniport for the Bluetooth (SSP1) mic.
+
+--*/
+#pragma warning (disable : 4127)
+
+#include "definitions.h"
+#include "endpoints.h"
+#include "mintopo.h"
+#include "bthhfpmictopo.h"
+#include "bthhfpmictoptable.h"
+
+//=============================================================================
+#pragma code_seg("PAGE")
+NTSTATUS
+PropertyHandler_BthHfpMicTopoFilter
+(
+    _In_ PPCPROPERTY_REQUEST      PropertyRequest
+)
+/*++
+
+Routine Description:
+
+  Redirects property request to miniport object
+
+Arguments:
+
+  PropertyRequest -
+
+Return Value:
+
+  NT status code.
+
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(PropertyRequest);
+
+    DPF_ENTER(("[PropertyHandler_BthHfpMicTopoFilter]"));
+
+    // PropertryRequest structure is filled by portcls. 
+    // MajorTarget is a pointer to miniport object for miniports.
+    //
+    NTSTATUS            ntStatus = STATUS_INVALID_DEVICE_REQUEST;
+    PCMiniportTopology  pMiniport = (PCMiniportTopology)PropertyRequest->MajorTarget;
+
+    if (IsEqualGUIDAligned(*PropertyRequest->PropertyItem->Set, KSPROPSETID_Jack))
+    {
+        switch (PropertyRequest->PropertyItem->Id)
+        {
+        case KSPROPERTY_JACK_DESCRIPTION:
+            ntStatus = pMiniport->PropertyHandlerJackDescription(
+                PropertyRequest,
+                ARRAYSIZE(BthHfpMicDescriptions),
+                BthHfpMicDescriptions);
+            break;
+
+        case KSPROPERTY_JACK_DESCRIPTION2:
+            ntStatus = pMiniport->PropertyHandlerJackDescription2(
+                PropertyRequest,
+                ARRAYSIZE(BthHfpMicDescriptions),
+                BthHfpMicDescriptions,
+                0 // jack capabilities
+            );
+            break;
+        }
+    }
+
+    return ntStatus;
+} // PropertyHandler_BthHfpMicTopoFilter
+
+//=============================================================================
+NTSTATUS
+PropertyHandler_BthHfpMicTopology
+(
+    _In_ PPCPROPERTY_REQUEST      PropertyRequest
+)
+/*++
+
+Routine Description:
+
+  Redirects property request to miniport object
+
+Arguments:
+
+  PropertyRequest -
+
+Return Value:
+
+  NT status code.
+
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(PropertyRequest);
+
+    DPF_ENTER(("[PropertyHandler_BthHfpMicTopology]"));
+
+    // PropertryRequest structure is filled by portcls. 
+    // MajorTarget is a pointer to miniport object for miniports.
+    //
+    PCMiniportTopology pMiniport = (PCMiniportTopology)PropertyRequest->MajorTarget;
+
+    return pMiniport->PropertyHandlerGeneric(PropertyRequest);
+} // PropertyHandler_BthHfpMicTopology
+
+#pragma code_seg()
@@ -0,0 +1,24 @@
+/*++
+
+Copyright (c) Microsoft Corporation All Rights Reserved
+
+Module Name:
+
+    bthhfpmictopo.h
+
+Abstract:
+
+    Declaration of topology miniport for the Bluetooth (SSP1) mic.
+
+--*/
+
+#ifndef _CSAUDIOSSTCATPT_BTHHFPMICTOPO_H_
+#define _CSAUDIOSSTCATPT_BTHHFPMICTOPO_H_
+
+// Function declarations.
+NTSTATUS
+PropertyHandler_BthHfpMicTopoFilter(_In_ PPCPROPERTY_REQUEST      PropertyRequest);
+
+NTSTATUS PropertyHandler_BthHfpMicTopology(_In_ PPCPROPERTY_REQUEST PropertyRequest);
+
+#endif // _CSAUDIOSSTCATPT_BTHHFPMICTOPO_H_
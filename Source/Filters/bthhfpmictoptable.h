@@ -0,0 +1,159 @@
+/*++
+
+Copyright (c) Microsoft Corporation All Rights Reserved
+
+Module Name:
+
+    bthhfpmictoptable.h
+
+Abstract:
+
+    Declaration of topology table for the Bluetooth (SSP1) mic
+
+--*/
+
+#ifndef _CSAUDIOSSTCATPT_BTHHFPMICTOPTABLE_H_
+#define _CSAUDIOSSTCATPT_BTHHFPMICTOPTABLE_H_
+
+//=============================================================================
+static
+KSDATARANGE BthHfpMicTopoPinDataRangesBridge[] =
+{
+ {
+   sizeof(KSDATARANGE),
+   0,
+   0,
+   0,
+   STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+   STATICGUIDOF(KSDATAFORMAT_SUBTYPE_ANALOG),
+   STATICGUIDOF(KSDATAFORMAT_SPECIFIER_NONE)
+ }
+};
+
+//=============================================================================
+static
+PKSDATARANGE BthHfpMicTopoPinDataRangePointersBridge[] =
+{
+  &BthHfpMicTopoPinDataRangesBridge[0]
+};
+
+//=============================================================================
+static
+PCPIN_DESCRIPTOR BthHfpMicTopoMiniportPins[] =
+{
+    // KSPIN_TOPO_MIC_ELEMENTS
+    {
+      0,
+      0,
+      0,                                                  // InstanceCount
+      NULL,                                               // AutomationTable
+      {                                                   // KsPinDescriptor
+        0,                                                // InterfacesCount
+        NULL,                                             // Interfaces
+        0,                                                // MediumsCount
+        NULL,                                             // Mediums
+        SIZEOF_ARRAY(BthHfpMicTopoPinDataRangePointersBridge),// DataRangesCount
+        BthHfpMicTopoPinDataRangePointersBridge,              // DataRanges
+        KSPIN_DATAFLOW_IN,                                // DataFlow
+        KSPIN_COMMUNICATION_NONE,                         // Communication
+        &KSNODETYPE_HEADSET_MICROPHONE,           // Category
+        NULL,                                             // Name
+        0                                                 // Reserved
+      }
+    },
+
+    // KSPIN_TOPO_BRIDGE
+    {
+      0,
+      0,
+      0,                                                  // InstanceCount
+      NULL,                                               // AutomationTable
+      {                                                   // KsPinDescriptor
+        0,                                                // InterfacesCount
+        NULL,                                             // Interfaces
+        0,                                                // MediumsCount
+        NULL,                                             // Mediums
+        SIZEOF_ARRAY(BthHfpMicTopoPinDataRangePointersBridge),// DataRangesCount
+        BthHfpMicTopoPinDataRangePointersBridge,              // DataRanges
+        KSPIN_DATAFLOW_OUT,                               // DataFlow
+        KSPIN_COMMUNICATION_NONE,                         // Communication
+        &KSCATEGORY_AUDIO,                                // Category
+        NULL,                                             // Name
+        0                                                 // Reserved
+      }
+    }
+};
+
+//=============================================================================
+static
+KSJACK_DESCRIPTION BthHfpMicDesc =
+{
+    KSAUDIO_SPEAKER_MONO,
+    JACKDESC_RGB(0, 0, 0),
+    eConnTypeOtherDigital,
+    eGeoLocNotApplicable,
+    eGenLocOther,
+    ePortConnUnknown,
+    TRUE
+};
+
+//=============================================================================
+// Only return a KSJACK_DESCRIPTION for the physical bridge pin.
+static
+PKSJACK_DESCRIPTION BthHfpMicDescriptions[] =
+{
+    &BthHfpMicDesc,
+    NULL
+};
+
+//=============================================================================
+static
+PCCONNECTION_DESCRIPTOR BthHfpMicMiniportConnections[] =
+{
+    //  FromNode,                 FromPin,                    ToNode,                 ToPin
+    {   PCFILTER_NODE,            KSPIN_TOPO_MIC_ELEMENTS,    PCFILTER_NODE,     KSPIN_TOPO_BRIDGE }
+};
+
+
+//=============================================================================
+static
+PCPROPERTY_ITEM BthHfpMicPropertiesTopoFilter[] =
+{
+    {
+        &KSPROPSETID_Jack,
+        KSPROPERTY_JACK_DESCRIPTION,
+        KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_BASICSUPPORT,
+        PropertyHandler_BthHfpMicTopoFilter
+    },
+    {
+        &KSPROPSETID_Jack,
+        KSPROPERTY_JACK_DESCRIPTION2,
+        KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_BASICSUPPORT,
+        PropertyHandler_BthHfpMicTopoFilter
+    }
+};
+
+
+DEFINE_PCAUTOMATION_TABLE_PROP(AutomationBthHfpMicTopoFilter,
+    BthHfpMicPropertiesTopoFilter);
+
+
+//=============================================================================
+static
+PCFILTER_DESCRIPTOR BthHfpMicTopoMiniportFilterDescriptor =
+{
+  0,                                        // Version
+  &AutomationBthHfpMicTopoFilter,  // AutomationTable
+  sizeof(PCPIN_DESCRIPTOR),                 // PinSize
+  SIZEOF_ARRAY(BthHfpMicTopoMiniportPins),  // PinCount
+  BthHfpMicTopoMiniportPins,                // Pins
+  sizeof(PCNODE_DESCRIPTOR),                // NodeSize
+  0,     // NodeCount
+  NULL,                   // Nodes
+  SIZEOF_ARRAY(BthHfpMicMiniportConnections),// ConnectionCount
+  BthHfpMicMiniportConnections,             // Connections
+  0,                                        // CategoryCount
+  NULL                                      // Categories
+};
+
+#endif // _CSAUDIOSSTCATPT_BTHHFPMICTOPTABLE_H_
@@ -0,0 +1,118 @@
+/*++
+
+Copyright (c) Microsoft Corporation All Rights Reserved
+
+Module Name:
+
+    bthhfpspeakertopo.cpp
+
+Abstract:
+
+    Implementation of topology miniport for the Bluetooth (SSP1) speaker.
+--*/
+
+#pragma warning (disable : 4127)
+
+#include "definitions.h"
+#include "endpoints.h"
+#include "mintopo.h"
+#include "bthhfpspeakertopo.h"
+#include "bthhfpspeakertoptable.h"
+
+
+#pragma code_seg("PAGE")
+//=============================================================================
+NTSTATUS
+PropertyHandler_BthHfpSpeakerTopoFilter
+( 
+    _In_ PPCPROPERTY_REQUEST      PropertyRequest 
+)
+/*++
+
+Routine Description:
+
+  Redirects property request to miniport object
+
+Arguments:
+
+  PropertyRequest - 
+
+Return Value:
+
+  NT status code.
+
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(PropertyRequest);
+
+    DPF_ENTER(("[PropertyHandler_BthHfpSpeakerTopoFilter]"));
+
+    // PropertryRequest structure is filled by portcls. 
+    // MajorTarget is a pointer to miniport object for miniports.
+    //
+    NTSTATUS            ntStatus = STATUS_INVALID_DEVICE_REQUEST;
+    PCMiniportTopology  pMiniport = (PCMiniportTopology)PropertyRequest->MajorTarget;
+
+    if (IsEqualGUIDAligned(*PropertyRequest->PropertyItem->Set, KSPROPSETID_Jack))
+    {
+        if (PropertyRequest->PropertyItem->Id == KSPROPERTY_JACK_DESCRIPTION)
+        {
+            ntStatus = pMiniport->PropertyHandlerJackDescription(
+                PropertyRequest,
+                ARRAYSIZE(BthHfpSpeakerJackDescriptions),
+                BthHfpSpeakerJackDescriptions
+                );
+        }
+        else if (PropertyRequest->PropertyItem->Id == KSPROPERTY_JACK_DESCRIPTION2)
+        {
+            ntStatus = pMiniport->PropertyHandlerJackDescription2(
+                PropertyRequest,
+                ARRAYSIZE(BthHfpSpeakerJackDescriptions),
+                BthHfpSpeakerJackDescriptions,
+                0 // jack capabilities
+                );
+        }
+    }
+
+    return ntStatus;
+} // PropertyHandler_BthHfpSpeakerTopoFilter
+
+//=============================================================================
+NTSTATUS
+PropertyHandler_BthHfpSpeakerTopology
+(
+    _In_ PPCPROPERTY_REQUEST      PropertyRequest
+)
+/*++
+
+Routine Description:
+
+  Redirects property request to miniport object
+
+Arguments:
+
+  PropertyRequest -
+
+Return Value:
+
+  NT status code.
+
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(PropertyRequest);
+
+    DPF_ENTER(("[PropertyHandler_BthHfpSpeakerTopology]"));
+
+    // PropertryRequest structure is filled by portcls. 
+    // MajorTarget is a pointer to miniport object for miniports.
+    //
+    PCMiniportTopology pMiniport = (PCMiniportTopology)PropertyRequest->MajorTarget;
+
+    return pMiniport->PropertyHandlerGeneric(PropertyRequest);
+} // PropertyHandler_BthHfpSpeakerTopology
+
+#pragma code_seg()
@@ -0,0 +1,22 @@
+
+/*++
+
+Copyright (c) Microsoft Corporation All Rights Reserved
+
+Module Name:
+
+    bthhfpspeakertopo.h
+
+Abstract:
+
+    Declaration of topology miniport for the Bluetooth (SSP1) speaker.
+--*/
+
+#ifndef _CSAUDIOSSTCATPT_BTHHFPSPEAKERTOPO_H_
+#define _CSAUDIOSSTCATPT_BTHHFPSPEAKERTOPO_H_
+
+NTSTATUS PropertyHandler_BthHfpSpeakerTopoFilter(_In_ PPCPROPERTY_REQUEST PropertyRequest);
+
+NTSTATUS PropertyHandler_BthHfpSpeakerTopology(_In_ PPCPROPERTY_REQUEST PropertyRequest);
+
+#endif // _CSAUDIOSSTCATPT_BTHHFPSPEAKERTOPO_H_
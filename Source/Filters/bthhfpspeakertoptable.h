@@ -0,0 +1,152 @@
+/*++
+
+Copyright (c) Microsoft Corporation All Rights Reserved
+
+Module Name:
+
+    bthhfpspeakertoptable.h
+
+Abstract:
+
+    Declaration of topology tables for the Bluetooth (SSP1) speaker.
+--*/
+
+#ifndef _CSAUDIOSSTCATPT_BTHHFPSPEAKERTOPTABLE_H_
+#define _CSAUDIOSSTCATPT_BTHHFPSPEAKERTOPTABLE_H_
+
+//=============================================================================
+static
+KSDATARANGE BthHfpSpeakerTopoPinDataRangesBridge[] =
+{
+ {
+   sizeof(KSDATARANGE),
+   0,
+   0,
+   0,
+   STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+   STATICGUIDOF(KSDATAFORMAT_SUBTYPE_ANALOG),
+   STATICGUIDOF(KSDATAFORMAT_SPECIFIER_NONE)
+ }
+};
+
+//=============================================================================
+static
+PKSDATARANGE BthHfpSpeakerTopoPinDataRangePointersBridge[] =
+{
+  &BthHfpSpeakerTopoPinDataRangesBridge[0]
+};
+
+//=============================================================================
+static
+PCPIN_DESCRIPTOR BthHfpSpeakerTopoMiniportPins[] =
+{
+  // KSPIN_TOPO_WAVEOUT_SOURCE
+  {
+    0,
+    0,
+    0,                                                  // InstanceCount
+    NULL,                                               // AutomationTable
+    {                                                   // KsPinDescriptor
+      0,                                                // InterfacesCount
+      NULL,                                             // Interfaces
+      0,                                                // MediumsCount
+      NULL,                                             // Mediums
+      SIZEOF_ARRAY(BthHfpSpeakerTopoPinDataRangePointersBridge),// DataRangesCount
+      BthHfpSpeakerTopoPinDataRangePointersBridge,            // DataRanges
+      KSPIN_DATAFLOW_IN,                                // DataFlow
+      KSPIN_COMMUNICATION_NONE,                         // Communication
+      &KSCATEGORY_AUDIO,                                // Category
+      NULL,                                             // Name
+      0                                                 // Reserved
+    }
+  },
+  // KSPIN_TOPO_LINEOUT_DEST
+  {
+    0,
+    0,
+    0,                                                  // InstanceCount
+    NULL,                                               // AutomationTable
+    {                                                   // KsPinDescriptor
+      0,                                                // InterfacesCount
+      NULL,                                             // Interfaces
+      0,                                                // MediumsCount
+      NULL,                                             // Mediums
+      SIZEOF_ARRAY(BthHfpSpeakerTopoPinDataRangePointersBridge),// DataRangesCount
+      BthHfpSpeakerTopoPinDataRangePointersBridge,            // DataRanges
+      KSPIN_DATAFLOW_OUT,                               // DataFlow
+      KSPIN_COMMUNICATION_NONE,                         // Communication
+      &KSNODETYPE_HEADSET_SPEAKERS,                      // Category
+      NULL,                                             // Name
+      0                                                 // Reserved
+    }
+  }
+};
+
+//=============================================================================
+static
+KSJACK_DESCRIPTION BthHfpSpeakerJackDescBridge =
+{
+    KSAUDIO_SPEAKER_MONO,
+    JACKDESC_RGB(0, 0, 0),
+    eConnTypeOtherDigital,
+    eGeoLocNotApplicable,
+    eGenLocOther,
+    ePortConnUnknown,
+    TRUE
+};
+
+// Only return a KSJACK_DESCRIPTION for the physical bridge pin.
+static 
+PKSJACK_DESCRIPTION BthHfpSpeakerJackDescriptions[] =
+{
+    NULL,
+    &BthHfpSpeakerJackDescBridge
+};
+
+static
+PCCONNECTION_DESCRIPTOR BthHfpSpeakerTopoMiniportConnections[] =
+{
+    {PCFILTER_NODE,            KSPIN_TOPO_WAVEOUT_SOURCE,    PCFILTER_NODE,     KSPIN_TOPO_LINEOUT_DEST} //no volume controls
+};
+
+//=============================================================================
+static
+PCPROPERTY_ITEM PropertiesBthHfpSpeakerTopoFilter[] =
+{
+    {
+        &KSPROPSETID_Jack,
+        KSPROPERTY_JACK_DESCRIPTION,
+        KSPROPERTY_TYPE_GET |
+        KSPROPERTY_TYPE_BASICSUPPORT,
+        PropertyHandler_BthHfpSpeakerTopoFilter
+    },
+    {
+        &KSPROPSETID_Jack,
+        KSPROPERTY_JACK_DESCRIPTION2,
+        KSPROPERTY_TYPE_GET |
+        KSPROPERTY_TYPE_BASICSUPPORT,
+        PropertyHandler_BthHfpSpeakerTopoFilter
+    }
+};
+
+DEFINE_PCAUTOMATION_TABLE_PROP(AutomationBthHfpSpeakerTopoFilter, PropertiesBthHfpSpeakerTopoFilter);
+
+//=============================================================================
+static
+PCFILTER_DESCRIPTOR BthHfpSpeakerTopoMiniportFilterDescriptor =
+{
+  0,                                            // Version
+  &AutomationBthHfpSpeakerTopoFilter,                 // AutomationTable
+  sizeof(PCPIN_DESCRIPTOR),                     // PinSize
+  SIZEOF_ARRAY(BthHfpSpeakerTopoMiniportPins),        // PinCount
+  BthHfpSpeakerTopoMiniportPins,                      // Pins
+  sizeof(PCNODE_DESCRIPTOR),                    // NodeSize
+  0,           // NodeCount
+  NULL,                         // Nodes
+  SIZEOF_ARRAY(BthHfpSpeakerTopoMiniportConnections), // ConnectionCount
+  BthHfpSpeakerTopoMiniportConnections,               // Connections
+  0,                                            // CategoryCount
+  NULL                                          // Categories
+};
+
+#endif // _CSAUDIOSSTCATPT_BTHHFPSPEAKERTOPTABLE_H_
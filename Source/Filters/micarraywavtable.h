@@ -20,13 +20,15 @@ Abstract:-
 //
 #define MICARRAY_RAW_CHANNELS                   2       // Channels for raw mode
 #define MICARRAY_DEVICE_MAX_CHANNELS            2       // Max channels overall
+#define MICARRAY_16_BITS_PER_SAMPLE_PCM         16      // 16 Bits Per Sample
 #define MICARRAY_32_BITS_PER_SAMPLE_PCM         32      // 32 Bits Per Sample
 #define MICARRAY_RAW_SAMPLE_RATE                48000   // Raw sample rate
+#define MICARRAY_SRC_SAMPLE_RATE                44100   // Converted on the DSP (SRC module)
 
 //
 // Max # of pin instances.
 //
-#define MICARRAY_MAX_INPUT_STREAMS              1
+#define MICARRAY_MAX_INPUT_STREAMS              2       // SSP0_IN + SSP0_IN_DUP
 
 //=============================================================================
 static
@@ -57,6 +59,84 @@ KSDATAFORMAT_WAVEFORMATEXTENSIBLE MicArrayPinSupportedDeviceFormats[] =
             KSAUDIO_SPEAKER_STEREO,
             STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
         }
+    },
+    // 48 KHz 24-bit (in 32-bit container) 2 channels
+    {
+        {
+            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
+            0,
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        {
+            {
+                WAVE_FORMAT_EXTENSIBLE,
+                2,
+                48000,
+                384000,
+                8,
+                32,
+                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
+            },
+            24,
+            KSAUDIO_SPEAKER_STEREO,
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
+        }
+    },
+    // 44.1 KHz 16-bit 2 channels
+    {
+        {
+            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
+            0,
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        {
+            {
+                WAVE_FORMAT_EXTENSIBLE,
+                2,
+                44100,
+                176400,
+                4,
+                16,
+                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
+            },
+            16,
+            KSAUDIO_SPEAKER_STEREO,
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
+        }
+    },
+    // 44.1 KHz 24-bit (in 32-bit container) 2 channels
+    {
+        {
+            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
+            0,
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        {
+            {
+                WAVE_FORMAT_EXTENSIBLE,
+                2,
+                44100,
+                352800,
+                8,
+                32,
+                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
+            },
+            24,
+            KSAUDIO_SPEAKER_STEREO,
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
+        }
     }
 };
 
@@ -114,11 +194,27 @@ KSDATARANGE_AUDIO MicArrayPinDataRangesRawStream[] =
             STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
         },
         MICARRAY_RAW_CHANNELS,
-        MICARRAY_32_BITS_PER_SAMPLE_PCM,
+        MICARRAY_16_BITS_PER_SAMPLE_PCM,
         MICARRAY_32_BITS_PER_SAMPLE_PCM,
         MICARRAY_RAW_SAMPLE_RATE,
         MICARRAY_RAW_SAMPLE_RATE
     },
+    {
+        {
+            sizeof(KSDATARANGE_AUDIO),
+            KSDATARANGE_ATTRIBUTES,         // An attributes list follows this data range
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        MICARRAY_RAW_CHANNELS,
+        MICARRAY_16_BITS_PER_SAMPLE_PCM,
+        MICARRAY_32_BITS_PER_SAMPLE_PCM,
+        MICARRAY_SRC_SAMPLE_RATE,
+        MICARRAY_SRC_SAMPLE_RATE
+    },
 };
 
 static
@@ -127,6 +223,8 @@ PKSDATARANGE MicArrayPinDataRangePointersStream[] =
     // All supported device formats should be listed in the DataRange.
     PKSDATARANGE(&MicArrayPinDataRangesRawStream[0]),
     PKSDATARANGE(&PinDataRangeAttributeList),
+    PKSDATARANGE(&MicArrayPinDataRangesRawStream[1]),
+    PKSDATARANGE(&PinDataRangeAttributeList),
 };
 
 //=============================================================================
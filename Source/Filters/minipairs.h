@@ -22,6 +22,14 @@ Abstract:
 #include "micjacktoptable.h"
 #include "micarraywavtable.h"
 
+#include "bthhfpspeakertopo.h"
+#include "bthhfpspeakertoptable.h"
+#include "bthhfpspeakerwavtable.h"
+
+#include "bthhfpmictopo.h"
+#include "bthhfpmictoptable.h"
+#include "bthhfpmicwavtable.h"
+
 
 NTSTATUS
 CreateMiniportWaveRTCsAudioSstCatPt
@@ -94,6 +102,49 @@ ENDPOINT_MINIPAIR SpeakerMiniports =
     ENDPOINT_NO_FLAGS,
 };
 
+/*********************************************************************
+* Topology/Wave bridge connection for Bluetooth speaker (SSP1)       *
+*                                                                    *
+*              +------+                +------+                      *
+*              | Wave |                | Topo |                      *
+*              |      |                |      |                      *
+* System   --->|0    1|--------------->|0    1|---> SCO Out          *
+*              |      |                |      |                      *
+*              +------+                +------+                      *
+*********************************************************************/
+static
+PHYSICALCONNECTIONTABLE BthHfpSpeakerTopologyPhysicalConnections[] =
+{
+    {
+        KSPIN_TOPO_WAVEOUT_SOURCE,  // TopologyIn
+        KSPIN_WAVE_RENDER3_SOURCE,   // WaveOut
+        CONNECTIONTYPE_WAVE_OUTPUT
+    }
+};
+
+static
+ENDPOINT_MINIPAIR BthHfpSpeakerMiniports =
+{
+    eBthHfpSpeakerDevice,
+    L"TopologyBthHfpSpeaker",                               // make sure this or the template name matches with KSNAME_TopologyBthHfpSpeaker in the inf's [Strings] section 
+    NULL,                                                   // optional template name
+    CreateMiniportTopologyCsAudioSstCatPt,
+    &BthHfpSpeakerTopoMiniportFilterDescriptor,
+    0, NULL,                                                // Interface properties
+    L"WaveBthHfpSpeaker",                                   // make sure this or the template name matches with KSNAME_WaveBthHfpSpeaker in the inf's [Strings] section
+    NULL,                                                   // optional template name
+    CreateMiniportWaveRTCsAudioSstCatPt,
+    &BthHfpSpeakerWaveMiniportFilterDescriptor,
+    0,                                                      // Interface properties
+    NULL,
+    BTHHFPSPEAKER_DEVICE_MAX_CHANNELS,
+    BthHfpSpeakerPinDeviceFormatsAndModes,
+    SIZEOF_ARRAY(BthHfpSpeakerPinDeviceFormatsAndModes),
+    BthHfpSpeakerTopologyPhysicalConnections,
+    SIZEOF_ARRAY(BthHfpSpeakerTopologyPhysicalConnections),
+    ENDPOINT_NO_FLAGS,
+};
+
 //
 // Capture miniports.
 //
@@ -141,6 +192,49 @@ ENDPOINT_MINIPAIR MicJackMiniports =
     ENDPOINT_NO_FLAGS,
 };
 
+/*********************************************************************
+* Topology/Wave bridge connection for Bluetooth mic (SSP1)           *
+*                                                                    *
+*              +------+    +------+                                  *
+*              | Topo |    | Wave |                                  *
+*              |      |    |      |                                  *
+*  SCO in  --->|0    1|===>|0    1|---> Capture Host Pin             *
+*              |      |    |      |                                  *
+*              +------+    +------+                                  *
+*********************************************************************/
+static
+PHYSICALCONNECTIONTABLE BthHfpMicTopologyPhysicalConnections[] =
+{
+    {
+        KSPIN_TOPO_BRIDGE,          // TopologyOut
+        KSPIN_WAVE_BRIDGE,          // WaveIn
+        CONNECTIONTYPE_TOPOLOGY_OUTPUT
+    }
+};
+
+static
+ENDPOINT_MINIPAIR BthHfpMicMiniports =
+{
+    eBthHfpMicDevice,
+    L"TopologyBthHfpMic",                   // make sure this or the template name matches with KSNAME_TopologyBthHfpMic in the inf's [Strings] section 
+    NULL,                                   // optional template name
+    CreateMiniportTopologyCsAudioSstCatPt,
+    &BthHfpMicTopoMiniportFilterDescriptor,
+    0, NULL,                                // Interface properties
+    L"WaveBthHfpMic",                       // make sure this or the template name matches with KSNAME_WaveBthHfpMic in the inf's [Strings] section
+    NULL,                                   // optional template name
+    CreateMiniportWaveRTCsAudioSstCatPt,
+    &BthHfpMicWaveMiniportFilterDescriptor,
+    0,                                      // Interface properties
+    NULL,
+    BTHHFPMIC_DEVICE_MAX_CHANNELS,
+    BthHfpMicPinDeviceFormatsAndModes,
+    SIZEOF_ARRAY(BthHfpMicPinDeviceFormatsAndModes),
+    BthHfpMicTopologyPhysicalConnections,
+    SIZEOF_ARRAY(BthHfpMicTopologyPhysicalConnections),
+    ENDPOINT_NO_FLAGS,
+};
+
 
 //=============================================================================
 //
@@ -151,6 +245,7 @@ static
 PENDPOINT_MINIPAIR  g_RenderEndpoints[] = 
 {
     &SpeakerMiniports,
+    &BthHfpSpeakerMiniports,
 };
 
 #define g_cRenderEndpoints  (SIZEOF_ARRAY(g_RenderEndpoints))
@@ -163,7 +258,8 @@ PENDPOINT_MINIPAIR  g_RenderEndpoints[] =
 static
 PENDPOINT_MINIPAIR  g_CaptureEndpoints[] =
 {
-    &MicJackMiniports
+    &MicJackMiniports,
+    &BthHfpMicMiniports
 };
 
 #define g_cCaptureEndpoints (SIZEOF_ARRAY(g_CaptureEndpoints))
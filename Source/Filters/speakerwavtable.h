@@ -14,20 +14,38 @@ Abstract:
 #ifndef _CSAUDIOSSTCATPT_SPEAKERWAVTABLE_H_
 #define _CSAUDIOSSTCATPT_SPEAKERWAVTABLE_H_
 
-// To keep the code simple assume device supports only 48KHz, 16-bit, stereo (PCM and NON-PCM)
+// Stereo at 44.1/48/96KHz, 16-bit or 24-bit in a 32-bit container.
+// 48KHz goes through the system pin as-is, other rates are resampled by the
+// DSP's PCM module, so the OS never has to convert.
 
 #define SPEAKER_DEVICE_MAX_CHANNELS                 2       // Max Channels.
 
 #define SPEAKER_HOST_MAX_CHANNELS                   2       // Max Channels.
 #define SPEAKER_HOST_MIN_BITS_PER_SAMPLE            16      // Min Bits Per Sample
-#define SPEAKER_HOST_MAX_BITS_PER_SAMPLE            16      // Max Bits Per Sample
-#define SPEAKER_HOST_MIN_SAMPLE_RATE                48000   // Min Sample Rate
-#define SPEAKER_HOST_MAX_SAMPLE_RATE                48000   // Max Sample Rate
+#define SPEAKER_HOST_MAX_BITS_PER_SAMPLE            32      // Max Bits Per Sample
 
 //
 // Max # of pin instances.
 //
 #define SPEAKER_MAX_INPUT_SYSTEM_STREAMS            1
+#define SPEAKER_MAX_INPUT_OFFLOAD_STREAMS           1
+
+//
+// Compressed offload pin: MP3 and AAC frames are decoded on the DSP.
+//
+#define SPEAKER_OFFLOAD_MAX_CHANNELS                2       // Max Channels.
+#define SPEAKER_OFFLOAD_MIN_SAMPLE_RATE             44100   // Min Sample Rate
+#define SPEAKER_OFFLOAD_MAX_SAMPLE_RATE             48000   // Max Sample Rate
+
+#ifndef STATIC_KSDATAFORMAT_SUBTYPE_MPEGLAYER3
+#define STATIC_KSDATAFORMAT_SUBTYPE_MPEGLAYER3 \
+    DEFINE_WAVEFORMATEX_GUID(WAVE_FORMAT_MPEGLAYER3)
+#endif
+
+#ifndef STATIC_KSDATAFORMAT_SUBTYPE_MPEG_HEAAC
+#define STATIC_KSDATAFORMAT_SUBTYPE_MPEG_HEAAC \
+    DEFINE_WAVEFORMATEX_GUID(WAVE_FORMAT_MPEG_HEAAC)
+#endif
 
 //=============================================================================
 
@@ -58,6 +76,240 @@ KSDATAFORMAT_WAVEFORMATEXTENSIBLE SpeakerHostPinSupportedDeviceFormats[] =
             KSAUDIO_SPEAKER_STEREO,
             STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
         }
+    },
+    { // 1
+        {
+            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
+            0,
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        {
+            {
+                WAVE_FORMAT_EXTENSIBLE,
+                2,
+                48000,
+                384000,
+                8,
+                32,
+                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
+            },
+            24,
+            KSAUDIO_SPEAKER_STEREO,
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
+        }
+    },
+    { // 2
+        {
+            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
+            0,
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        {
+            {
+                WAVE_FORMAT_EXTENSIBLE,
+                2,
+                44100,
+                176400,
+                4,
+                16,
+                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
+            },
+            16,
+            KSAUDIO_SPEAKER_STEREO,
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
+        }
+    },
+    { // 3
+        {
+            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
+            0,
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        {
+            {
+                WAVE_FORMAT_EXTENSIBLE,
+                2,
+                44100,
+                352800,
+                8,
+                32,
+                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
+            },
+            24,
+            KSAUDIO_SPEAKER_STEREO,
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
+        }
+    },
+    { // 4
+        {
+            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
+            0,
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        {
+            {
+                WAVE_FORMAT_EXTENSIBLE,
+                2,
+                96000,
+                384000,
+                4,
+                16,
+                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
+            },
+            16,
+            KSAUDIO_SPEAKER_STEREO,
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
+        }
+    },
+    { // 5
+        {
+            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
+            0,
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        {
+            {
+                WAVE_FORMAT_EXTENSIBLE,
+                2,
+                96000,
+                768000,
+                8,
+                32,
+                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
+            },
+            24,
+            KSAUDIO_SPEAKER_STEREO,
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
+        }
+    }
+};
+
+//
+// Compressed formats are matched on tag, channels, rate, block align (1) and
+// bits per sample (0 for MP3, decoded depth for AAC); the bitrate is free.
+//
+static
+KSDATAFORMAT_WAVEFORMATEXTENSIBLE SpeakerOffloadPinSupportedDeviceFormats[] =
+{
+    { // 0
+        {
+            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
+            0,
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_MPEGLAYER3),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        {
+            {
+                WAVE_FORMAT_MPEGLAYER3,
+                2,
+                44100,
+                40000,
+                1,
+                0,
+                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
+            },
+            0,
+            KSAUDIO_SPEAKER_STEREO,
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_MPEGLAYER3)
+        }
+    },
+    { // 1
+        {
+            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
+            0,
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_MPEGLAYER3),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        {
+            {
+                WAVE_FORMAT_MPEGLAYER3,
+                2,
+                48000,
+                40000,
+                1,
+                0,
+                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
+            },
+            0,
+            KSAUDIO_SPEAKER_STEREO,
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_MPEGLAYER3)
+        }
+    },
+    { // 2
+        {
+            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
+            0,
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_MPEG_HEAAC),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        {
+            {
+                WAVE_FORMAT_MPEG_HEAAC,
+                2,
+                44100,
+                40000,
+                1,
+                16,
+                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
+            },
+            0,
+            KSAUDIO_SPEAKER_STEREO,
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_MPEG_HEAAC)
+        }
+    },
+    { // 3
+        {
+            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
+            0,
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_MPEG_HEAAC),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        {
+            {
+                WAVE_FORMAT_MPEG_HEAAC,
+                2,
+                48000,
+                40000,
+                1,
+                16,
+                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
+            },
+            0,
+            KSAUDIO_SPEAKER_STEREO,
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_MPEG_HEAAC)
+        }
     }
 };
 
@@ -93,6 +345,13 @@ PIN_DEVICE_FORMATS_AND_MODES SpeakerPinDeviceFormatsAndModes[] =
         0,
         NULL,
         0
+    },
+    {
+        OffloadRenderPin,
+        SpeakerOffloadPinSupportedDeviceFormats,
+        SIZEOF_ARRAY(SpeakerOffloadPinSupportedDeviceFormats),
+        NULL,
+        0
     }
 };
 
@@ -110,11 +369,43 @@ KSDATARANGE_AUDIO SpeakerPinDataRangesStream[] =
             STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
             STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
         },
-        SPEAKER_HOST_MAX_CHANNELS,           
-        SPEAKER_HOST_MIN_BITS_PER_SAMPLE,    
-        SPEAKER_HOST_MAX_BITS_PER_SAMPLE,    
-        SPEAKER_HOST_MIN_SAMPLE_RATE,            
-        SPEAKER_HOST_MAX_SAMPLE_RATE             
+        SPEAKER_HOST_MAX_CHANNELS,
+        SPEAKER_HOST_MIN_BITS_PER_SAMPLE,
+        SPEAKER_HOST_MAX_BITS_PER_SAMPLE,
+        48000,
+        48000
+    },
+    { // 1
+        {
+            sizeof(KSDATARANGE_AUDIO),
+            KSDATARANGE_ATTRIBUTES,         // An attributes list follows this data range
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        SPEAKER_HOST_MAX_CHANNELS,
+        SPEAKER_HOST_MIN_BITS_PER_SAMPLE,
+        SPEAKER_HOST_MAX_BITS_PER_SAMPLE,
+        44100,
+        44100
+    },
+    { // 2
+        {
+            sizeof(KSDATARANGE_AUDIO),
+            KSDATARANGE_ATTRIBUTES,         // An attributes list follows this data range
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        SPEAKER_HOST_MAX_CHANNELS,
+        SPEAKER_HOST_MIN_BITS_PER_SAMPLE,
+        SPEAKER_HOST_MAX_BITS_PER_SAMPLE,
+        96000,
+        96000
     }
 };
 
@@ -123,8 +414,71 @@ PKSDATARANGE SpeakerPinDataRangePointersStream[] =
 {
     PKSDATARANGE(&SpeakerPinDataRangesStream[0]),
     PKSDATARANGE(&PinDataRangeAttributeList),
+    PKSDATARANGE(&SpeakerPinDataRangesStream[1]),
+    PKSDATARANGE(&PinDataRangeAttributeList),
+    PKSDATARANGE(&SpeakerPinDataRangesStream[2]),
+    PKSDATARANGE(&PinDataRangeAttributeList),
+};
+
+//=============================================================================
+static
+KSDATARANGE_AUDIO SpeakerPinDataRangesOffload[] =
+{
+    {
+        {
+            sizeof(KSDATARANGE_AUDIO),
+            0,
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_MPEGLAYER3),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        SPEAKER_OFFLOAD_MAX_CHANNELS,
+        0,
+        0,
+        SPEAKER_OFFLOAD_MIN_SAMPLE_RATE,
+        SPEAKER_OFFLOAD_MAX_SAMPLE_RATE
+    },
+    {
+        {
+            sizeof(KSDATARANGE_AUDIO),
+            0,
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_MPEG_HEAAC),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        SPEAKER_OFFLOAD_MAX_CHANNELS,
+        16,
+        16,
+        SPEAKER_OFFLOAD_MIN_SAMPLE_RATE,
+        SPEAKER_OFFLOAD_MAX_SAMPLE_RATE
+    }
+};
+
+static
+PKSDATARANGE SpeakerPinDataRangePointersOffload[] =
+{
+    PKSDATARANGE(&SpeakerPinDataRangesOffload[0]),
+    PKSDATARANGE(&SpeakerPinDataRangesOffload[1]),
 };
 
+//=============================================================================
+static
+PCPROPERTY_ITEM PropertiesSpeakerOffloadPin[] =
+{
+    {
+        &KSPROPSETID_Audio,
+        KSPROPERTY_AUDIO_WAVERT_CURRENT_WRITE_POSITION,
+        KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
+        PropertyHandler_OffloadPin
+    }
+};
+
+DEFINE_PCAUTOMATION_TABLE_PROP(AutomationSpeakerOffloadPin, PropertiesSpeakerOffloadPin);
+
 //=============================================================================
 static
 KSDATARANGE SpeakerPinDataRangesBridge[] =
@@ -190,6 +544,26 @@ PCPIN_DESCRIPTOR SpeakerWaveMiniportPins[] =
             0
         }
     },
+    // Wave Out Offload Pin (Renderer) KSPIN_WAVE_RENDER3_SINK_OFFLOAD
+    {
+        SPEAKER_MAX_INPUT_OFFLOAD_STREAMS,
+        SPEAKER_MAX_INPUT_OFFLOAD_STREAMS,
+        0,
+        &AutomationSpeakerOffloadPin,   // AutomationTable
+        {
+            0,
+            NULL,
+            0,
+            NULL,
+            SIZEOF_ARRAY(SpeakerPinDataRangePointersOffload),
+            SpeakerPinDataRangePointersOffload,
+            KSPIN_DATAFLOW_IN,
+            KSPIN_COMMUNICATION_SINK,
+            &KSCATEGORY_AUDIO,
+            NULL,
+            0
+        }
+    },
 };
 
 //=============================================================================
@@ -198,11 +572,14 @@ PCPIN_DESCRIPTOR SpeakerWaveMiniportPins[] =
 //                   |                          |      
 //  Host Pin     0-->|                          |--> 1 KSPIN_WAVE_RENDER3_SOURCE
 //                   |                          |      
+//  Offload Pin  2-->|                          |
+//                   |                          |      
 //                   ----------------------------
 static
 PCCONNECTION_DESCRIPTOR SpeakerWaveMiniportConnections[] =
 {
-    { PCFILTER_NODE,            KSPIN_WAVE_RENDER3_SINK_SYSTEM,     PCFILTER_NODE,   KSPIN_WAVE_RENDER3_SOURCE }
+    { PCFILTER_NODE,            KSPIN_WAVE_RENDER3_SINK_SYSTEM,     PCFILTER_NODE,   KSPIN_WAVE_RENDER3_SOURCE },
+    { PCFILTER_NODE,            KSPIN_WAVE_RENDER3_SINK_OFFLOAD,    PCFILTER_NODE,   KSPIN_WAVE_RENDER3_SOURCE }
 };
 
 //=============================================================================
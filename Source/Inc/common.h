@@ -124,6 +124,11 @@ typedef enum
 {
     eSpeakerDevice = 0,
     eMicJackDevice,
+    eBthHfpSpeakerDevice,
+    eBthHfpMicDevice,
+    // DSP streams that hang off another endpoint's filter
+    eSpeakerOffloadDevice,
+    eMicJackDupDevice,
     eMaxDeviceType,
 } eDeviceType;
 
@@ -143,6 +148,7 @@ typedef enum
     NoPin,
     BridgePin,
     SystemRenderPin,
+    OffloadRenderPin,
     SystemCapturePin,
 } PINTYPE;
 
@@ -281,7 +287,8 @@ DECLARE_INTERFACE_(IAdapterCommon, IUnknown)
             _In_ eDeviceType deviceType,
             _In_ UINT32 byteCount,
             _In_ PMDL mdl,
-            _In_ IPortWaveRTStream * stream
+            _In_ IPortWaveRTStream * stream,
+            _In_ PWAVEFORMATEXTENSIBLE format
         ) PURE;
 
     STDMETHOD_(NTSTATUS, StartDMA)
@@ -301,6 +308,23 @@ DECLARE_INTERFACE_(IAdapterCommon, IUnknown)
             _Out_ UINT32 * linkPos,
             _Out_ UINT64 * linearPos
         ) PURE;
+    STDMETHOD_(NTSTATUS, SetWritePosition)
+        (
+            THIS_
+            _In_ eDeviceType deviceType,
+            _In_ UINT32 writePos
+        ) PURE;
+    STDMETHOD_(BOOL, IsFormatSupported)
+        (
+            THIS_
+            _In_ eDeviceType deviceType,
+            _In_ PWAVEFORMATEX format
+        ) PURE;
+    STDMETHOD_(VOID, ReleaseDMA)
+        (
+            THIS_
+            _In_ PMDL mdl
+        ) PURE;
 
     STDMETHOD_(BOOL,            bDevSpecificRead)
     (
@@ -28,11 +28,12 @@ DEFINE_GUIDSTRUCT("0104947F-82AE-4291-A6F3-5E2DE1AD7DC2", NAME_SIMPLE_AUDIO_SAMP
 // Default pin instances.
 #define MAX_INPUT_SYSTEM_STREAMS        1
 
-// Wave pins - no mix, no offload
+// Wave pins - no mix, optional compressed offload sink after the source
 enum 
 {
     KSPIN_WAVE_RENDER3_SINK_SYSTEM = 0, 
-    KSPIN_WAVE_RENDER3_SOURCE
+    KSPIN_WAVE_RENDER3_SOURCE,
+    KSPIN_WAVE_RENDER3_SINK_OFFLOAD
 };
 
 // Wave pins - offloading is NOT supported.
@@ -40,6 +40,23 @@ private:
     PCCsAudioCatptSSTHW        m_pHW;                  // HW object
     PPORTCLSETWHELPER       m_pPortClsEtwHelper;
 
+    PIO_WORKITEM            m_BringUpWorkItem;      // runs sst_init off the PnP/power thread
+    KEVENT                  m_HwReady;              // signalled while no bring-up is pending
+    NTSTATUS                m_HwStatus;             // result of the last bring-up
+
+    KTIMER                  m_IdleTimer;            // runtime idle: no streams for m_DspIdleMs
+    KDPC                    m_IdleDpc;
+    PIO_WORKITEM            m_IdleWorkItem;
+    LONG                    m_IdleQueued;
+    KEVENT                  m_IdleDone;             // signalled while no idle worker is pending
+    KEVENT                  m_PmLock;               // serializes runtime D3 against stream setup
+    BOOL                    m_DspAsleep;            // DSP in D3 while the device is in D0
+    KSPIN_LOCK              m_StopLock;             // guards m_DspOff and m_StopsActive
+    BOOL                    m_DspOff;               // DSP down or on its way down, StopDMA stays off it
+    LONG                    m_StopsActive;          // StopDMA calls talking to the DSP
+    KEVENT                  m_StopsDone;            // signalled while m_StopsActive is 0
+    ULONG                   m_DspIdleMs;
+
     static LONG             m_AdapterInstances;     // # of adapter objects.
 
     DWORD                   m_dwIdleRequests;
@@ -78,7 +95,8 @@ private:
         _In_ eDeviceType deviceType,
         _In_ UINT32 byteCount,
         _In_ PMDL mdl,
-        _In_ IPortWaveRTStream* stream);
+        _In_ IPortWaveRTStream* stream,
+        _In_ PWAVEFORMATEXTENSIBLE format);
 
     STDMETHODIMP_(NTSTATUS) StartDMA(
         _In_ eDeviceType deviceType
@@ -91,6 +109,17 @@ private:
         _Out_ UINT32* linkPos,
         _Out_ UINT64* linearPos
     );
+    STDMETHODIMP_(NTSTATUS) SetWritePosition(
+        _In_ eDeviceType deviceType,
+        _In_ UINT32 writePos
+    );
+    STDMETHODIMP_(BOOL) IsFormatSupported(
+        _In_ eDeviceType deviceType,
+        _In_ PWAVEFORMATEX format
+    );
+    STDMETHODIMP_(VOID) ReleaseDMA(
+        _In_ PMDL mdl
+    );
 
     STDMETHODIMP_(BOOL)     bDevSpecificRead();
 
@@ -250,6 +279,23 @@ private:
 
     VOID EmptySubdeviceCache();
 
+    VOID WriteBootTelemetry();
+    VOID WriteDxTelemetry();
+    VOID ReadHwParameters();
+
+    VOID QueueBringUp();
+    NTSTATUS WaitForHw();
+    static IO_WORKITEM_ROUTINE BringUpWorker;
+
+    VOID ArmIdle();
+    VOID FlushIdle();
+    BOOL BeginStop();
+    VOID EndStop();
+    VOID SetDspOff(_In_ BOOL Off);
+    NTSTATUS WakeHw();
+    static KDEFERRED_ROUTINE IdleDpc;
+    static IO_WORKITEM_ROUTINE IdleWorker;
+
     NTSTATUS CreateAudioInterfaceWithProperties
     (
         _In_ PCWSTR                                                 ReferenceString,
@@ -416,9 +462,26 @@ Return Value:
     PAGED_CODE();
     DPF_ENTER(("[CAdapterCommon::~CAdapterCommon]"));
 
+    if (m_BringUpWorkItem)
+    {
+        WaitForHw();
+        IoFreeWorkItem(m_BringUpWorkItem);
+        m_BringUpWorkItem = NULL;
+    }
+
+    if (m_IdleWorkItem)
+    {
+        FlushIdle();
+        IoFreeWorkItem(m_IdleWorkItem);
+        m_IdleWorkItem = NULL;
+    }
+
     if (m_pHW)
     {
-        m_pHW->sst_deinit();
+        if (!m_DspOff)
+        {
+            m_pHW->sst_deinit();
+        }
         delete m_pHW;
         m_pHW = NULL;
     }
@@ -554,6 +617,22 @@ Return Value:
     m_PowerState            = PowerDeviceD0;
     m_pHW                   = NULL;
     m_pPortClsEtwHelper     = NULL;
+    m_BringUpWorkItem       = NULL;
+    m_HwStatus              = STATUS_DEVICE_NOT_READY;
+    m_IdleWorkItem          = NULL;
+    m_IdleQueued            = 0;
+    m_DspAsleep             = FALSE;
+    m_DspOff                = TRUE;
+    m_StopsActive           = 0;
+    m_DspIdleMs             = CATPT_DSP_IDLE_MS;
+
+    KeInitializeEvent(&m_HwReady, NotificationEvent, TRUE);
+    KeInitializeTimer(&m_IdleTimer);
+    KeInitializeDpc(&m_IdleDpc, CAdapterCommon::IdleDpc, this);
+    KeInitializeEvent(&m_IdleDone, NotificationEvent, TRUE);
+    KeInitializeEvent(&m_PmLock, SynchronizationEvent, TRUE);
+    KeInitializeSpinLock(&m_StopLock);
+    KeInitializeEvent(&m_StopsDone, NotificationEvent, TRUE);
 
     InitializeListHead(&m_SubdeviceCache);
 
@@ -585,7 +664,7 @@ Return Value:
 
     // Initialize HW.
     // 
-    m_pHW = new (NonPagedPool, CSAUDIOCATPTSST_POOLTAG)  CCsAudioCatptSSTHW(ResourceList);
+    m_pHW = new (NonPagedPool, CSAUDIOCATPTSST_POOLTAG)  CCsAudioCatptSSTHW(ResourceList, DeviceObject);
     if (!m_pHW)
     {
         DPF(D_TERSE, ("Insufficient memory for Smart Sound HW"));
@@ -600,10 +679,29 @@ Return Value:
     }
     IF_FAILED_JUMP(ntStatus, Done);
 
-    ntStatus = m_pHW->sst_init();
-    if (!NT_SUCCESS(ntStatus))
+    ReadHwParameters();
+
+    // without it the DSP only powers down with the device
+    m_IdleWorkItem = IoAllocateWorkItem(DeviceObject);
+
+    //
+    // DSP bring-up takes a few hundred ms, let endpoint registration go
+    // ahead and have streams wait for it in WaitForHw.
+    //
+    m_BringUpWorkItem = IoAllocateWorkItem(DeviceObject);
+    if (m_BringUpWorkItem)
     {
-        DPF(D_TERSE, ("Unable to in initialize Intel SST"));
+        QueueBringUp();
+    }
+    else
+    {
+        m_HwStatus = m_pHW->sst_init();
+        if (!NT_SUCCESS(m_HwStatus))
+        {
+            DPF(D_TERSE, ("Unable to in initialize Intel SST"));
+        }
+        SetDspOff(FALSE);
+        ntStatus = m_HwStatus;
     }
     IF_FAILED_JUMP(ntStatus, Done);
     
@@ -740,9 +838,177 @@ CAdapterCommon::SetEtwHelper
     if (m_pPortClsEtwHelper)
     {
         m_pPortClsEtwHelper->AddRef();
+
+        // The first boot happened in Init, before the helper was available.
+        WriteBootTelemetry();
     }
 } // SetEtwHelper
 
+//=============================================================================
+#pragma code_seg()
+VOID
+CAdapterCommon::WriteBootTelemetry()
+/*++
+
+Routine Description:
+
+  Reports the phase timestamps of the last DSP boot, one
+  eMINIPORT_IHV_DEFINED event per phase reached, followed by
+  the delay and poll counts since that boot.
+
+Return Value:
+
+  VOID
+
+--*/
+{
+    const struct catpt_boot_times *times;
+
+    if (!m_pHW || !m_pPortClsEtwHelper)
+    {
+        return;
+    }
+
+    times = m_pHW->sst_boot_times();
+    for (ULONG phase = 0; phase < CATPT_BOOT_PHASE_COUNT; phase++)
+    {
+        if (!times->phase[phase])
+        {
+            continue;
+        }
+
+        WriteEtwEvent(eMINIPORT_IHV_DEFINED,
+                      CATPT_ETW_BOOT_PHASE,
+                      phase,
+                      times->phase[phase] / 10,
+                      times->restore);
+    }
+
+    WriteEtwEvent(eMINIPORT_IHV_DEFINED,
+                  CATPT_ETW_BOOT_WAITS,
+                  times->waits.spins,
+                  times->waits.sleeps,
+                  times->waits.polls);
+
+    const struct catpt_clock_stats *clock = m_pHW->sst_clock_stats();
+    WriteEtwEvent(eMINIPORT_IHV_DEFINED,
+                  CATPT_ETW_CLOCK,
+                  clock->switches,
+                  clock->held,
+                  clock->waitTime / 10);
+} // WriteBootTelemetry
+
+//=============================================================================
+#pragma code_seg()
+VOID
+CAdapterCommon::WriteDxTelemetry()
+/*++
+
+Routine Description:
+
+  Reports the phase timestamps of the last DSP power down, the
+  counterpart of WriteBootTelemetry for sst_deinit.
+
+Return Value:
+
+  VOID
+
+--*/
+{
+    const struct catpt_dx_times *times;
+
+    if (!m_pHW || !m_pPortClsEtwHelper)
+    {
+        return;
+    }
+
+    times = m_pHW->sst_dx_times();
+    for (ULONG phase = 0; phase < CATPT_DX_PHASE_COUNT; phase++)
+    {
+        if (!times->phase[phase])
+        {
+            continue;
+        }
+
+        WriteEtwEvent(eMINIPORT_IHV_DEFINED,
+                      CATPT_ETW_DX_PHASE,
+                      phase,
+                      times->phase[phase] / 10,
+                      times->saved);
+    }
+
+    WriteEtwEvent(eMINIPORT_IHV_DEFINED,
+                  CATPT_ETW_DX_WAITS,
+                  times->waits.spins,
+                  times->waits.sleeps,
+                  times->waits.polls);
+} // WriteDxTelemetry
+
+//=============================================================================
+#pragma code_seg("PAGE")
+VOID
+CAdapterCommon::ReadHwParameters()
+/*++
+
+Routine Description:
+
+  Applies optional tuning values from the driver's software key.
+  LpClockIdleMs (DWORD) sets how long the DSP stays on the high clock
+  after the last stream goes away; 0 switches back immediately.
+  DspIdleMs (DWORD) sets how long the DSP stays in D0 without
+  streams; 0 keeps it up for as long as the device is.
+
+Return Value:
+
+  VOID
+
+--*/
+{
+    PAGED_CODE();
+
+    NTSTATUS        ntStatus;
+    HANDLE          hKey = NULL;
+    UNICODE_STRING  valueName;
+    UCHAR           buffer[sizeof(KEY_VALUE_PARTIAL_INFORMATION) + sizeof(ULONG)];
+    PKEY_VALUE_PARTIAL_INFORMATION info = (PKEY_VALUE_PARTIAL_INFORMATION)buffer;
+    ULONG           resultLength;
+
+    ntStatus = IoOpenDeviceRegistryKey(m_pPhysicalDeviceObject,
+                                       PLUGPLAY_REGKEY_DRIVER,
+                                       KEY_READ,
+                                       &hKey);
+    if (!NT_SUCCESS(ntStatus))
+    {
+        return;
+    }
+
+    RtlInitUnicodeString(&valueName, L"LpClockIdleMs");
+    ntStatus = ZwQueryValueKey(hKey,
+                               &valueName,
+                               KeyValuePartialInformation,
+                               info,
+                               sizeof(buffer),
+                               &resultLength);
+    if (NT_SUCCESS(ntStatus) && info->Type == REG_DWORD && info->DataLength == sizeof(ULONG))
+    {
+        m_pHW->sst_set_lpclock_idle(*(PULONG)info->Data);
+    }
+
+    RtlInitUnicodeString(&valueName, L"DspIdleMs");
+    ntStatus = ZwQueryValueKey(hKey,
+                               &valueName,
+                               KeyValuePartialInformation,
+                               info,
+                               sizeof(buffer),
+                               &resultLength);
+    if (NT_SUCCESS(ntStatus) && info->Type == REG_DWORD && info->DataLength == sizeof(ULONG))
+    {
+        m_DspIdleMs = *(PULONG)info->Data;
+    }
+
+    ZwClose(hKey);
+} // ReadHwParameters
+
 //=============================================================================
 #pragma code_seg("PAGE")
 STDMETHODIMP
@@ -834,26 +1100,361 @@ Return Value:
 
 //=============================================================================
 #pragma code_seg()
+VOID
+CAdapterCommon::QueueBringUp()
+/*++
+
+Routine Description:
+
+  Closes the readiness gate and hands sst_init to a system worker thread.
+
+Return Value:
+
+  VOID
+
+--*/
+{
+    KeClearEvent(&m_HwReady);
+    IoQueueWorkItem(m_BringUpWorkItem, CAdapterCommon::BringUpWorker, DelayedWorkQueue, this);
+} // QueueBringUp
+
+//=============================================================================
+#pragma code_seg("PAGE")
+_Use_decl_annotations_
+VOID
+CAdapterCommon::BringUpWorker
+(
+    PDEVICE_OBJECT  DeviceObject,
+    PVOID           Context
+)
+{
+    PAGED_CODE();
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    CAdapterCommon *that = (CAdapterCommon *)Context;
+
+    that->m_HwStatus = that->m_pHW->sst_init();
+    if (!NT_SUCCESS(that->m_HwStatus))
+    {
+        DPF(D_TERSE, ("Unable to in initialize Intel SST"));
+    }
+    that->WriteBootTelemetry();
+    that->SetDspOff(FALSE);
+
+    // armed while the gate is still closed, so a destructor past
+    // WaitForHw always finds the timer for FlushIdle to cancel
+    that->ArmIdle();
+    KeSetEvent(&that->m_HwReady, IO_NO_INCREMENT, FALSE);
+} // BringUpWorker
+
+//=============================================================================
+#pragma code_seg("PAGE")
+NTSTATUS
+CAdapterCommon::WaitForHw()
+/*++
+
+Routine Description:
+
+  Readiness gate. Returns at once unless a bring-up is still running.
+
+Return Value:
+
+  NT status code of the last bring-up.
+
+--*/
+{
+    PAGED_CODE();
+
+    KeWaitForSingleObject(&m_HwReady, Executive, KernelMode, FALSE, NULL);
+    return m_HwStatus;
+} // WaitForHw
+
+//=============================================================================
+#pragma code_seg()
+VOID
+CAdapterCommon::ArmIdle()
+/*++
+
+Routine Description:
+
+  (Re)starts the runtime idle countdown once no stream is left on the DSP.
+
+Return Value:
+
+  VOID
+
+--*/
+{
+    LARGE_INTEGER due;
+
+    if (!m_IdleWorkItem || !m_DspIdleMs || !m_pHW->sst_idle())
+    {
+        return;
+    }
+
+    due.QuadPart = -10000LL * m_DspIdleMs;
+    KeSetTimer(&m_IdleTimer, due, &m_IdleDpc);
+} // ArmIdle
+
+//=============================================================================
+#pragma code_seg()
+_Use_decl_annotations_
+VOID
+CAdapterCommon::IdleDpc
+(
+    PKDPC   Dpc,
+    PVOID   DeferredContext,
+    PVOID   SystemArgument1,
+    PVOID   SystemArgument2
+)
+{
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(SystemArgument1);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+
+    CAdapterCommon *that = (CAdapterCommon *)DeferredContext;
+
+    if (InterlockedExchange(&that->m_IdleQueued, 1))
+    {
+        return;
+    }
+    KeClearEvent(&that->m_IdleDone);
+    IoQueueWorkItem(that->m_IdleWorkItem, CAdapterCommon::IdleWorker, DelayedWorkQueue, that);
+} // IdleDpc
+
+//=============================================================================
+#pragma code_seg("PAGE")
+_Use_decl_annotations_
+VOID
+CAdapterCommon::IdleWorker
+(
+    PDEVICE_OBJECT  DeviceObject,
+    PVOID           Context
+)
+{
+    PAGED_CODE();
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    CAdapterCommon *that = (CAdapterCommon *)Context;
+
+    // saves the DX context, so WakeHw takes the resume path
+    if (NT_SUCCESS(that->WaitForHw()))
+    {
+        BOOL down = FALSE;
+        KIRQL oldIrql;
+
+        KeWaitForSingleObject(&that->m_PmLock, Executive, KernelMode, FALSE, NULL);
+        if (!that->m_DspAsleep &&
+            that->m_PowerState == PowerDeviceD0 &&
+            that->m_pHW->sst_idle())
+        {
+            // a StopDMA still on the DSP re-arms the timer when it is done
+            KeAcquireSpinLock(&that->m_StopLock, &oldIrql);
+            if (!that->m_StopsActive)
+            {
+                that->m_DspOff = TRUE;
+                down = TRUE;
+            }
+            KeReleaseSpinLock(&that->m_StopLock, oldIrql);
+        }
+        if (down)
+        {
+            DPF(D_VERBOSE, ("DSP idle, entering D3"));
+            that->m_pHW->sst_deinit();
+            that->WriteDxTelemetry();
+            that->m_DspAsleep = TRUE;
+        }
+        KeSetEvent(&that->m_PmLock, IO_NO_INCREMENT, FALSE);
+    }
+
+    InterlockedExchange(&that->m_IdleQueued, 0);
+    KeSetEvent(&that->m_IdleDone, IO_NO_INCREMENT, FALSE);
+} // IdleWorker
+
+//=============================================================================
+#pragma code_seg("PAGE")
+VOID
+CAdapterCommon::FlushIdle()
+/*++
+
+Routine Description:
+
+  Cancels the idle countdown and waits out an idle worker already queued.
+
+Return Value:
+
+  VOID
+
+--*/
+{
+    PAGED_CODE();
+
+    if (!m_IdleWorkItem)
+    {
+        return;
+    }
+
+    KeCancelTimer(&m_IdleTimer);
+    KeFlushQueuedDpcs();
+    KeWaitForSingleObject(&m_IdleDone, Executive, KernelMode, FALSE, NULL);
+} // FlushIdle
+
+//=============================================================================
+#pragma code_seg()
+BOOL
+CAdapterCommon::BeginStop()
+/*++
+
+Routine Description:
+
+  Lets a StopDMA onto the DSP unless it is down or going down. Safe at
+  DISPATCH_LEVEL, nothing here waits.
+
+Return Value:
+
+  TRUE if the caller may talk to the DSP and must call EndStop.
+
+--*/
+{
+    KIRQL oldIrql;
+    BOOL  ok = FALSE;
+
+    KeAcquireSpinLock(&m_StopLock, &oldIrql);
+    if (!m_DspOff)
+    {
+        if (!m_StopsActive++)
+        {
+            KeClearEvent(&m_StopsDone);
+        }
+        ok = TRUE;
+    }
+    KeReleaseSpinLock(&m_StopLock, oldIrql);
+
+    return ok;
+} // BeginStop
+
+//=============================================================================
+#pragma code_seg()
+VOID
+CAdapterCommon::EndStop()
+{
+    KIRQL oldIrql;
+
+    KeAcquireSpinLock(&m_StopLock, &oldIrql);
+    if (!--m_StopsActive)
+    {
+        KeSetEvent(&m_StopsDone, IO_NO_INCREMENT, FALSE);
+    }
+    KeReleaseSpinLock(&m_StopLock, oldIrql);
+} // EndStop
+
+//=============================================================================
+#pragma code_seg()
+VOID
+CAdapterCommon::SetDspOff
+(
+    _In_ BOOL Off
+)
+/*++
+
+Routine Description:
+
+  Opens or closes the DSP to StopDMA. Closing does not wait for stops
+  already in flight, callers powering down wait on m_StopsDone.
+
+Return Value:
+
+  VOID
+
+--*/
+{
+    KIRQL oldIrql;
+
+    KeAcquireSpinLock(&m_StopLock, &oldIrql);
+    m_DspOff = Off;
+    KeReleaseSpinLock(&m_StopLock, oldIrql);
+} // SetDspOff
+
+//=============================================================================
+#pragma code_seg("PAGE")
+NTSTATUS
+CAdapterCommon::WakeHw()
+/*++
+
+Routine Description:
+
+  Brings the DSP back from runtime idle. With the firmware image
+  resident this is a DX context restore, no file I/O and no cold boot.
+  Caller holds m_PmLock.
+
+Return Value:
+
+  NT status code of the DSP.
+
+--*/
+{
+    PAGED_CODE();
+
+    KeCancelTimer(&m_IdleTimer);
+
+    if (m_DspAsleep)
+    {
+        m_DspAsleep = FALSE;
+        m_HwStatus = m_pHW->sst_init();
+        if (!NT_SUCCESS(m_HwStatus))
+        {
+            DPF(D_TERSE, ("Unable to wake Intel SST"));
+        }
+        WriteBootTelemetry();
+        SetDspOff(FALSE);
+    }
+
+    return m_HwStatus;
+} // WakeHw
+
+//=============================================================================
+#pragma code_seg("PAGE")
 STDMETHODIMP_(NTSTATUS)
 CAdapterCommon::PrepareDMA(
     _In_ eDeviceType deviceType,
     _In_ UINT32 byteCount,
     _In_ PMDL mdl,
-    _In_ IPortWaveRTStream* stream
+    _In_ IPortWaveRTStream* stream,
+    _In_ PWAVEFORMATEXTENSIBLE format
 ) {
+    PAGED_CODE();
+
     if (m_pHW) {
-        return  m_pHW->sst_program_dma(deviceType, byteCount, mdl, stream);
+        NTSTATUS status = WaitForHw();
+        if (!NT_SUCCESS(status)) {
+            return status;
+        }
+
+        // held until the stream exists, so the idle worker cannot slip in
+        KeWaitForSingleObject(&m_PmLock, Executive, KernelMode, FALSE, NULL);
+        status = WakeHw();
+        if (NT_SUCCESS(status)) {
+            status = m_pHW->sst_program_dma(deviceType, byteCount, mdl, stream, format);
+        }
+        KeSetEvent(&m_PmLock, IO_NO_INCREMENT, FALSE);
+        return status;
     }
     return STATUS_NO_SUCH_DEVICE;
 }
 
 //=============================================================================
-#pragma code_seg()
+#pragma code_seg("PAGE")
 STDMETHODIMP_(NTSTATUS)
 CAdapterCommon::StartDMA(
     _In_ eDeviceType deviceType
 ) {
+    PAGED_CODE();
+
     if (m_pHW) {
+        NTSTATUS status = WaitForHw();
+        if (!NT_SUCCESS(status)) {
+            return status;
+        }
         return m_pHW->sst_play(deviceType);
     }
     return STATUS_NO_SUCH_DEVICE;
@@ -866,7 +1467,25 @@ CAdapterCommon::StopDMA(
     _In_ eDeviceType deviceType
 ) {
     if (m_pHW) {
-        return m_pHW->sst_stop(deviceType);
+        NTSTATUS status;
+
+        // no waiting here; a bring-up still in flight has nothing to stop yet
+        if (!KeReadStateEvent(&m_HwReady)) {
+            return STATUS_DEVICE_NOT_READY;
+        }
+        status = m_HwStatus;
+        if (!NT_SUCCESS(status)) {
+            return status;
+        }
+        // runtime idle only happens with every stream already freed,
+        // and a DSP on its way down is not touched at all
+        if (!BeginStop()) {
+            return STATUS_SUCCESS;
+        }
+        status = m_pHW->sst_stop(deviceType);
+        EndStop();
+        ArmIdle();
+        return status;
     }
     return STATUS_NO_SUCH_DEVICE;
 }
@@ -885,6 +1504,53 @@ CAdapterCommon::CurrentPosition(
     return STATUS_NO_SUCH_DEVICE;
 }
 
+//=============================================================================
+#pragma code_seg()
+STDMETHODIMP_(NTSTATUS)
+CAdapterCommon::SetWritePosition(
+    _In_ eDeviceType deviceType,
+    _In_ UINT32 writePos
+) {
+    if (m_pHW) {
+        return m_pHW->sst_set_write_position(deviceType, writePos);
+    }
+    return STATUS_NO_SUCH_DEVICE;
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+STDMETHODIMP_(BOOL)
+CAdapterCommon::IsFormatSupported(
+    _In_ eDeviceType deviceType,
+    _In_ PWAVEFORMATEX format
+) {
+    BOOL supported;
+
+    PAGED_CODE();
+
+    // the answer comes from the firmware image, which the bring-up reads
+    if (!m_pHW || !NT_SUCCESS(WaitForHw())) {
+        return FALSE;
+    }
+
+    // a wake may re-read the image, keep it from swapping the manifest
+    KeWaitForSingleObject(&m_PmLock, Executive, KernelMode, FALSE, NULL);
+    supported = m_pHW->sst_format_supported(deviceType, format);
+    KeSetEvent(&m_PmLock, IO_NO_INCREMENT, FALSE);
+    return supported;
+}
+
+//=============================================================================
+#pragma code_seg()
+STDMETHODIMP_(VOID)
+CAdapterCommon::ReleaseDMA(
+    _In_ PMDL mdl
+) {
+    if (m_pHW) {
+        m_pHW->sst_release_buffer(mdl);
+    }
+}
+
 //=============================================================================
 #pragma code_seg()
 STDMETHODIMP_(BOOL)
@@ -1229,13 +1895,36 @@ Note:
         switch (NewState.DeviceState)
         {
             case PowerDeviceD0:
-                m_pHW->sst_init();
+                if (m_BringUpWorkItem)
+                {
+                    QueueBringUp();
+                }
+                else
+                {
+                    m_HwStatus = m_pHW->sst_init();
+                    WriteBootTelemetry();
+                    SetDspOff(FALSE);
+                }
                 break;
             case PowerDeviceD1:
             case PowerDeviceD2:
                 break;
             case PowerDeviceD3:
-                m_pHW->sst_deinit();
+                // never power down under a bring-up still in flight
+                WaitForHw();
+                FlushIdle();
+                KeWaitForSingleObject(&m_PmLock, Executive, KernelMode, FALSE, NULL);
+                SetDspOff(TRUE);
+                KeWaitForSingleObject(&m_StopsDone, Executive, KernelMode, FALSE, NULL);
+                // already down if runtime idle got there first
+                if (!m_DspAsleep)
+                {
+                    m_pHW->sst_deinit();
+                    WriteDxTelemetry();
+                }
+                m_DspAsleep = FALSE;
+                m_PowerState = PowerDeviceD3;
+                KeSetEvent(&m_PmLock, IO_NO_INCREMENT, FALSE);
                 break;
             default:
             
@@ -18,7 +18,6 @@ Abstract:
 #include "endpoints.h"
 #include "minwavert.h"
 #include "minwavertstream.h"
-#include "micarraywavtable.h"
 
 #define EFFECTS_LIST_COUNT 2
 
@@ -171,8 +170,8 @@ Routine Description:
   The DataRangeIntersection function determines the highest quality 
   intersection of two data ranges.
 
-  This sample just sets the ResultantFormat to be the only supported
-  format for the MicArray endpoint.
+  For capture endpoints this sets the ResultantFormat to be the first
+  supported format of the capture pin.
 
 Arguments:
 
@@ -202,8 +201,6 @@ Arguments:
 
 --*/
 {
-    UNREFERENCED_PARAMETER(PinId);
-
     ULONG                   requiredSize;
 
     PAGED_CODE();
@@ -213,10 +210,23 @@ Arguments:
         return STATUS_NOT_IMPLEMENTED;
     }
 
-    //If called for the mic array/jack pins, set ResultantFormat to be the endpoint's only supported format.
+    // Skip ranges the loaded firmware image has no modules for.
+    if (!IsDataRangeSupported(PinId, MyDataRange))
+    {
+        return STATUS_NO_MATCH;
+    }
+
+    //If called for the capture pins, set ResultantFormat to be the endpoint's default format.
     //Otherwise, allow the class handler to set ResultantFormat.  
-    if ((this->m_DeviceType) == eMicJackDevice)
+    if (!IsRenderDevice())
     {
+        PKSDATAFORMAT_WAVEFORMATEXTENSIBLE pPinFormats = NULL;
+
+        if (!IsSystemCapturePin(PinId))
+        {
+            return STATUS_NO_MATCH;
+        }
+
         requiredSize = sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE);
 
         //
@@ -234,10 +244,12 @@ Arguments:
             return STATUS_BUFFER_TOO_SMALL;
         }
 
-        //Set ResultantFormat to be the only supported format for the MicArray endpoint. 
+        //Set ResultantFormat to be the first supported format of the capture pin. 
+        GetPinSupportedDeviceFormats(PinId, &pPinFormats);
+
         PKSDATAFORMAT_WAVEFORMATEXTENSIBLE resultantFormat;
         resultantFormat = (PKSDATAFORMAT_WAVEFORMATEXTENSIBLE)ResultantFormat;
-        *resultantFormat = *MicArrayPinSupportedDeviceFormats;
+        *resultantFormat = *pPinFormats;
         *ResultantFormatLength = requiredSize;
 
         return STATUS_SUCCESS;
@@ -360,30 +372,34 @@ Return Value:
     // Init class data members
     //
     m_ulSystemAllocated                 = 0;
+    m_ulOffloadAllocated                = 0;
     m_SystemStreams                     = NULL;
     m_pMixFormat                        = NULL;
     m_pDeviceFormat                     = NULL;
     m_ulMixDrmContentId                 = 0;
     RtlZeroMemory(&m_MixDrmRights, sizeof(m_MixDrmRights));
 
+    if (m_ulMaxSystemStreams == 0 )
+    {
+        return STATUS_INVALID_DEVICE_STATE;
+    }
+
+    //
+    // System streams. Capture uses the slot index to pick the DSP stream,
+    // see GetStreamDeviceType.
+    //
+    size = sizeof(PCMiniportWaveRTStream) * m_ulMaxSystemStreams;
+    m_SystemStreams = (PCMiniportWaveRTStream *)ExAllocatePoolZero(NonPagedPool, size, MINWAVERT_POOLTAG);
+    if (m_SystemStreams == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
     //
     // Init the audio-engine used by the render devices.
     //
     if (IsRenderDevice())
     {
-        if (m_ulMaxSystemStreams == 0 )
-        {
-            return STATUS_INVALID_DEVICE_STATE;
-        }
-            
-        // System streams.
-        size = sizeof(PCMiniportWaveRTStream) * m_ulMaxSystemStreams;
-        m_SystemStreams = (PCMiniportWaveRTStream *)ExAllocatePoolZero(NonPagedPool, size, MINWAVERT_POOLTAG);
-        if (m_SystemStreams == NULL)
-        {
-            return STATUS_INSUFFICIENT_RESOURCES;
-        }
-        
         // 
         // For DRM support.
         //
@@ -720,6 +736,10 @@ CMiniportWaveRT::ValidateStreamCreate
         {
             VERIFY_PIN_INSTANCE_RESOURCES_AVAILABLE(ntStatus, m_ulSystemAllocated, m_ulMaxSystemStreams);
         }
+        else if (IsOffloadRenderPin(_Pin))
+        {
+            VERIFY_PIN_INSTANCE_RESOURCES_AVAILABLE(ntStatus, m_ulOffloadAllocated, m_ulMaxOffloadStreams);
+        }
     }
 
     return ntStatus;
@@ -844,6 +864,17 @@ BOOL CMiniportWaveRT::IsSystemRenderPin(ULONG nPinId)
     return (pinType == SystemRenderPin);
 }
 
+#pragma code_seg()
+BOOL CMiniportWaveRT::IsOffloadRenderPin(ULONG nPinId)
+{
+    AcquireFormatsAndModesLock();
+
+    PINTYPE pinType = m_DeviceFormatsAndModes[nPinId].PinType;
+
+    ReleaseFormatsAndModesLock();
+    return (pinType == OffloadRenderPin);
+}
+
 #pragma code_seg()
 BOOL CMiniportWaveRT::IsBridgePin(ULONG nPinId)
 {
@@ -871,17 +902,18 @@ CMiniportWaveRT::StreamCreated
     
     DPF_ENTER(("[CMiniportWaveRT::StreamCreated]"));
 
-    ALLOCATE_PIN_INSTANCE_RESOURCES(m_ulSystemAllocated);
-
-    if (IsSystemCapturePin(_Pin))
+    if (IsOffloadRenderPin(_Pin))
     {
+        ALLOCATE_PIN_INSTANCE_RESOURCES(m_ulOffloadAllocated);
         return STATUS_SUCCESS;
     }
-    else if (IsSystemRenderPin(_Pin))
+
+    ALLOCATE_PIN_INSTANCE_RESOURCES(m_ulSystemAllocated);
+
+    if (IsSystemCapturePin(_Pin) || IsSystemRenderPin(_Pin))
     {
         streams = m_SystemStreams;
         count = m_ulMaxSystemStreams;
-
     }
     
     //
@@ -924,6 +956,12 @@ CMiniportWaveRT::StreamClosed
     if (IsSystemCapturePin(_Pin))
     {
         FREE_PIN_INSTANCE_RESOURCES(m_ulSystemAllocated);
+        streams = m_SystemStreams;
+        count = m_ulMaxSystemStreams;
+    }
+    else if (IsOffloadRenderPin(_Pin))
+    {
+        FREE_PIN_INSTANCE_RESOURCES(m_ulOffloadAllocated);
         return STATUS_SUCCESS;
     }
     else if (IsSystemRenderPin(_Pin))
@@ -1127,9 +1165,49 @@ CMiniportWaveRT::IsFormatSupported
         break;
     }
 
+    // The table lists what the endpoint can carry, the firmware image
+    // decides what the DSP can actually run.
+    if (NT_SUCCESS(ntStatus) && m_pAdapterCommon &&
+        !m_pAdapterCommon->IsFormatSupported(GetPinDeviceType(_ulPin),
+            reinterpret_cast<PWAVEFORMATEX>(_pDataFormat + 1)))
+    {
+        ntStatus = STATUS_NO_MATCH;
+    }
+
     return ntStatus;
 }
 
+//=============================================================================
+#pragma code_seg("PAGE")
+BOOL
+CMiniportWaveRT::IsDataRangeSupported
+(
+    _In_ ULONG          _ulPin,
+    _In_ PKSDATARANGE   _pDataRange
+)
+{
+    PKSDATARANGE_AUDIO  pRange = (PKSDATARANGE_AUDIO)_pDataRange;
+    WAVEFORMATEX        waveFormat;
+
+    PAGED_CODE();
+
+    if (!m_pAdapterCommon ||
+        _pDataRange->FormatSize < sizeof(KSDATARANGE_AUDIO) ||
+        !IsEqualGUIDAligned(_pDataRange->MajorFormat, KSDATAFORMAT_TYPE_AUDIO))
+    {
+        return TRUE;
+    }
+
+    // Every range here is a single rate, probe the DSP with it.
+    RtlZeroMemory(&waveFormat, sizeof(waveFormat));
+    waveFormat.wFormatTag = EXTRACT_WAVEFORMATEX_ID(&_pDataRange->SubFormat);
+    waveFormat.nChannels = (WORD)pRange->MaximumChannels;
+    waveFormat.nSamplesPerSec = pRange->MaximumSampleFrequency;
+    waveFormat.wBitsPerSample = (WORD)pRange->MaximumBitsPerSample;
+
+    return m_pAdapterCommon->IsFormatSupported(GetPinDeviceType(_ulPin), &waveFormat);
+}
+
 //=============================================================================
 #pragma code_seg("PAGE")
 NTSTATUS
@@ -1667,37 +1745,155 @@ exit:
     return ntStatus;
 }
 
+//=============================================================================
+#pragma code_seg("PAGE")
+NTSTATUS
+PropertyHandler_OffloadPin
+( 
+    _In_ PPCPROPERTY_REQUEST      PropertyRequest 
+)
+/*++
+
+Routine Description:
+
+  Handles the write position of the compressed offload pin. The client
+  reports how far valid encoded data extends in the ring, and the DSP
+  decodes up to that point.
+
+Arguments:
+
+  PropertyRequest - 
+
+Return Value:
+
+  NT status code.
+
+--*/
+{
+    NTSTATUS                ntStatus = STATUS_INVALID_DEVICE_REQUEST;
+    CMiniportWaveRT*        pWave = NULL;
+    CMiniportWaveRTStream * pStream = NULL;
+
+    PAGED_CODE();
+
+    if (PropertyRequest->MajorTarget == NULL ||
+        PropertyRequest->MinorTarget == NULL)
+    {
+        ntStatus = STATUS_INVALID_PARAMETER;
+        goto exit;
+    }
+
+    pWave = MajorTarget_to_Obj(PropertyRequest->MajorTarget);
+    pWave->AddRef();
+
+    pStream = MinorTarget_to_Obj(PropertyRequest->MinorTarget);
+    pStream->AddRef();
+
+    if (IsEqualGUIDAligned(*PropertyRequest->PropertyItem->Set, KSPROPSETID_Audio) &&
+        PropertyRequest->PropertyItem->Id == KSPROPERTY_AUDIO_WAVERT_CURRENT_WRITE_POSITION)
+    {
+        if (PropertyRequest->Verb & KSPROPERTY_TYPE_BASICSUPPORT)
+        {
+            ntStatus = PropertyHandler_BasicSupport(PropertyRequest, KSPROPERTY_TYPE_SET, VT_UI4);
+        }
+        else if (PropertyRequest->Verb & KSPROPERTY_TYPE_SET)
+        {
+            if (PropertyRequest->ValueSize < sizeof(ULONG))
+            {
+                ntStatus = STATUS_BUFFER_TOO_SMALL;
+                goto exit;
+            }
+
+            ntStatus = pStream->SetCurrentWritePosition(*(PULONG)PropertyRequest->Value);
+        }
+    }
+
+exit:
+
+    SAFE_RELEASE(pStream);
+    SAFE_RELEASE(pWave);
+    
+    return ntStatus;
+}
+
 #pragma code_seg()
 NTSTATUS
 CMiniportWaveRT::AcquireDMA(_In_ PCMiniportWaveRTStream _Stream, UINT32 byteCount) {
     if (!m_pAdapterCommon) {
         return STATUS_NO_SUCH_DEVICE;
     }
-    return m_pAdapterCommon->PrepareDMA(m_DeviceType, byteCount, _Stream->m_pMDL, _Stream->m_pPortStream);
+    return m_pAdapterCommon->PrepareDMA(GetStreamDeviceType(_Stream), byteCount, _Stream->m_pMDL, _Stream->m_pPortStream, _Stream->m_pWfExt);
+}
+
+NTSTATUS
+CMiniportWaveRT::StartDMA(_In_ PCMiniportWaveRTStream _Stream) {
+    if (!m_pAdapterCommon) {
+        return STATUS_NO_SUCH_DEVICE;
+    }
+    return m_pAdapterCommon->StartDMA(GetStreamDeviceType(_Stream));
 }
 
 NTSTATUS
-CMiniportWaveRT::StartDMA() {
+CMiniportWaveRT::StopDMA(_In_ PCMiniportWaveRTStream _Stream) {
     if (!m_pAdapterCommon) {
         return STATUS_NO_SUCH_DEVICE;
     }
-    return m_pAdapterCommon->StartDMA(m_DeviceType);
+    return m_pAdapterCommon->StopDMA(GetStreamDeviceType(_Stream));
 }
 
 NTSTATUS
-CMiniportWaveRT::StopDMA() {
+CMiniportWaveRT::CurrentPosition(_In_ PCMiniportWaveRTStream _Stream, UINT32* linkPos, UINT64* linearPos) {
     if (!m_pAdapterCommon) {
         return STATUS_NO_SUCH_DEVICE;
     }
-    return m_pAdapterCommon->StopDMA(m_DeviceType);
+    return m_pAdapterCommon->CurrentPosition(GetStreamDeviceType(_Stream), linkPos, linearPos);
 }
 
 NTSTATUS
-CMiniportWaveRT::CurrentPosition(UINT32* linkPos, UINT64* linearPos) {
+CMiniportWaveRT::SetWritePosition(_In_ PCMiniportWaveRTStream _Stream, UINT32 writePos) {
     if (!m_pAdapterCommon) {
         return STATUS_NO_SUCH_DEVICE;
     }
-    return m_pAdapterCommon->CurrentPosition(m_DeviceType, linkPos, linearPos);
+    return m_pAdapterCommon->SetWritePosition(GetStreamDeviceType(_Stream), writePos);
+}
+
+VOID
+CMiniportWaveRT::ReleaseDMA(_In_ PMDL mdl) {
+    if (m_pAdapterCommon) {
+        m_pAdapterCommon->ReleaseDMA(mdl);
+    }
+}
+
+//
+// Each pin of a filter maps onto its own DSP stream. The system pins use the
+// endpoint's stream, the compressed offload pin has a separate one. A second
+// instance of the mic jack capture pin reads the duplicated SSP0 input.
+//
+eDeviceType
+CMiniportWaveRT::GetStreamDeviceType(_In_ PCMiniportWaveRTStream _Stream) {
+    if (IsOffloadRenderPin(_Stream->m_ulPin)) {
+        return eSpeakerOffloadDevice;
+    }
+    if (m_DeviceType == eMicJackDevice && m_SystemStreams != NULL) {
+        for (ULONG i = 1; i < m_ulMaxSystemStreams; i++) {
+            if (m_SystemStreams[i] == _Stream) {
+                return eMicJackDupDevice;
+            }
+        }
+    }
+    return m_DeviceType;
+}
+
+//
+// Format checks happen before a stream exists, go by the pin alone. The
+// duplicated mic input runs the same modules as the first one.
+//
+eDeviceType
+CMiniportWaveRT::GetPinDeviceType(_In_ ULONG _ulPin) {
+    if (IsOffloadRenderPin(_ulPin)) {
+        return eSpeakerOffloadDevice;
+    }
+    return m_DeviceType;
 }
 
 #pragma code_seg()
@@ -34,6 +34,7 @@ class CMiniportWaveRT :
 {
 private:
     ULONG                               m_ulSystemAllocated;
+    ULONG                               m_ulOffloadAllocated;
 
     ULONG                               m_ulMaxSystemStreams;
     ULONG                               m_ulMaxOffloadStreams;
@@ -94,11 +95,28 @@ public:
         UINT32 byteCount
     );
 
-    NTSTATUS StartDMA();
+    NTSTATUS StartDMA(
+        _In_ PCMiniportWaveRTStream _Stream
+    );
+
+    NTSTATUS StopDMA(
+        _In_ PCMiniportWaveRTStream _Stream
+    );
+
+    NTSTATUS CurrentPosition(
+        _In_ PCMiniportWaveRTStream _Stream,
+        UINT32* linkPos,
+        UINT64* linearPos
+    );
 
-    NTSTATUS StopDMA();
+    NTSTATUS SetWritePosition(
+        _In_ PCMiniportWaveRTStream _Stream,
+        UINT32 writePos
+    );
 
-    NTSTATUS CurrentPosition(UINT32* linkPos, UINT64* linearPos);
+    VOID ReleaseDMA(
+        _In_ PMDL mdl
+    );
     
     NTSTATUS IsFormatSupported
     ( 
@@ -107,6 +125,12 @@ public:
         _In_ PKSDATAFORMAT  _pDataFormat
     );
 
+    BOOL IsDataRangeSupported
+    (
+        _In_ ULONG          _ulPin,
+        _In_ PKSDATARANGE   _pDataRange
+    );
+
     static NTSTATUS GetAttributesFromAttributeList
     (
         _In_ const KSMULTIPLE_ITEM *_pAttributes,
@@ -131,6 +155,8 @@ public:
     )
         :CUnknown(0),
         m_ulMaxSystemStreams(0),
+        m_ulMaxOffloadStreams(0),
+        m_ulMaxLoopbackStreams(0),
         m_DeviceType(MiniportPair->DeviceType),
         m_DeviceContext(DeviceContext),
         m_DeviceMaxChannels(MiniportPair->DeviceMaxChannels),
@@ -150,28 +176,22 @@ public:
             RtlCopyMemory(&m_FilterDesc, MiniportPair->WaveDescriptor, sizeof(m_FilterDesc));
             
             //
-            // Get the max # of pin instances.
+            // Get the max # of pin instances. The formats and modes table
+            // follows the pin descriptor order, so use it to find each pin.
             //
-            if (IsRenderDevice())
-            {
-                if (m_FilterDesc.PinCount > KSPIN_WAVE_RENDER2_SOURCE)
-                {
-                    m_ulMaxSystemStreams = m_FilterDesc.Pins[KSPIN_WAVE_RENDER2_SINK_SYSTEM].MaxFilterInstanceCount;
-                    m_ulMaxLoopbackStreams = m_FilterDesc.Pins[KSPIN_WAVE_RENDER2_SINK_LOOPBACK].MaxFilterInstanceCount;
-                }
-                else if(m_FilterDesc.PinCount > KSPIN_WAVE_RENDER3_SOURCE)
-                {
-                    m_ulMaxSystemStreams = m_FilterDesc.Pins[KSPIN_WAVE_RENDER3_SINK_SYSTEM].MaxFilterInstanceCount;
-                }
-            }
-            else
+            for (ULONG i = 0; i < m_FilterDesc.PinCount && i < m_DeviceFormatsAndModesCount; i++)
             {
-                //
-                // capture bridge pin comes first in the enumeration
-                //
-                if (m_FilterDesc.PinCount > KSPIN_WAVEIN_HOST)
+                switch (m_DeviceFormatsAndModes[i].PinType)
                 {
-                    m_ulMaxSystemStreams = m_FilterDesc.Pins[KSPIN_WAVEIN_HOST].MaxFilterInstanceCount;
+                case SystemRenderPin:
+                case SystemCapturePin:
+                    m_ulMaxSystemStreams = m_FilterDesc.Pins[i].MaxFilterInstanceCount;
+                    break;
+                case OffloadRenderPin:
+                    m_ulMaxOffloadStreams = m_FilterDesc.Pins[i].MaxFilterInstanceCount;
+                    break;
+                default:
+                    break;
                 }
             }
         }
@@ -239,15 +259,22 @@ protected:
 #pragma code_seg()
     BOOL IsRenderDevice()
     {
-        return (m_DeviceType == eSpeakerDevice) ? TRUE : FALSE;
+        return (m_DeviceType == eSpeakerDevice ||
+                m_DeviceType == eBthHfpSpeakerDevice) ? TRUE : FALSE;
     }
 
     BOOL IsSystemRenderPin(ULONG nPinId);
 
+    BOOL IsOffloadRenderPin(ULONG nPinId);
+
     BOOL IsSystemCapturePin(ULONG nPinId);
 
     BOOL IsBridgePin(ULONG nPinId);
 
+    eDeviceType GetStreamDeviceType(_In_ PCMiniportWaveRTStream _Stream);
+
+    eDeviceType GetPinDeviceType(_In_ ULONG _ulPin);
+
     // These three pins are the pins used by the audio engine for host, loopback, and offload.
     ULONG GetSystemPinId()
     {
@@ -112,6 +112,7 @@ Return Value:
     m_ulDmaMovementRate = 0;
     m_pWfExt = NULL;
     m_ulContentId = 0;
+    m_ulWritePosition = 0;
 
     m_pPortStream = PortStream_;
 
@@ -282,12 +283,106 @@ _In_        ULONG       Size_
 
     if (Mdl_ != NULL)
     {
+        // Drop the DSP page table built for this ring before its pages go.
+        if (m_pMiniport != NULL)
+        {
+            m_pMiniport->ReleaseDMA(Mdl_);
+        }
         m_pPortStream->FreePagesFromMdl(Mdl_);
     }
 
     m_ulDmaBufferSize = 0;
 }
 
+#if DBG
+//=============================================================================
+#pragma code_seg("PAGE")
+static
+VOID
+MeasureRingCaching
+(
+    _In_    ULONG   Size_
+)
+/*++
+
+Routine Description:
+
+  Debug builds only. Times the CPU side of the ring, the audio engine
+  writing a render buffer and reading a capture buffer, with the ring
+  mapped under each caching type it could be handed out with, and prints
+  the throughput of each.
+
+Arguments:
+
+  Size_ - ring size to copy, as requested by the audio engine.
+
+Return Value:
+
+  VOID
+
+--*/
+{
+    static const MEMORY_CACHING_TYPE cacheTypes[] = { MmNonCached, MmWriteCombined, MmCached };
+    static const char *cacheNames[] = { "non-cached", "write-combined", "cached" };
+    const ULONG passes = 16;
+    PHYSICAL_ADDRESS lowAddress, highAddress, skipBytes;
+    LARGE_INTEGER frequency, start, end;
+    PUCHAR pSource;
+
+    PAGED_CODE();
+
+    pSource = (PUCHAR)ExAllocatePoolZero(NonPagedPool, Size_, MINWAVERTSTREAM_POOLTAG);
+    if (NULL == pSource)
+    {
+        return;
+    }
+
+    lowAddress.QuadPart = 0;
+    highAddress.QuadPart = MAXULONG;
+    skipBytes.QuadPart = 0;
+
+    for (ULONG i = 0; i < ARRAYSIZE(cacheTypes); i++)
+    {
+        ULONGLONG writeTicks, readTicks;
+        PUCHAR pRing;
+
+        pRing = (PUCHAR)MmAllocateContiguousMemorySpecifyCache(Size_, lowAddress, highAddress, skipBytes, cacheTypes[i]);
+        if (NULL == pRing)
+        {
+            continue;
+        }
+
+        // Warm up the TLB and, for the cached case, the caches.
+        RtlCopyMemory(pRing, pSource, Size_);
+
+        start = KeQueryPerformanceCounter(&frequency);
+        for (ULONG pass = 0; pass < passes; pass++)
+        {
+            RtlCopyMemory(pRing, pSource, Size_);
+        }
+        end = KeQueryPerformanceCounter(NULL);
+        writeTicks = (ULONGLONG)(end.QuadPart - start.QuadPart);
+
+        start = KeQueryPerformanceCounter(NULL);
+        for (ULONG pass = 0; pass < passes; pass++)
+        {
+            RtlCopyMemory(pSource, pRing, Size_);
+        }
+        end = KeQueryPerformanceCounter(NULL);
+        readTicks = (ULONGLONG)(end.QuadPart - start.QuadPart);
+
+        MmFreeContiguousMemorySpecifyCache(pRing, Size_, cacheTypes[i]);
+
+        DPF(D_TERSE, ("Ring copy, %s: render %llu MB/s, capture %llu MB/s",
+            cacheNames[i],
+            (ULONGLONG)Size_ * passes * frequency.QuadPart / max(writeTicks, 1) >> 20,
+            (ULONGLONG)Size_ * passes * frequency.QuadPart / max(readTicks, 1) >> 20));
+    }
+
+    ExFreePoolWithTag(pSource, MINWAVERTSTREAM_POOLTAG);
+}
+#endif
+
 //=============================================================================
 #pragma code_seg("PAGE")
 NTSTATUS CMiniportWaveRTStream::AllocateAudioBuffer
@@ -323,10 +418,19 @@ _Out_   MEMORY_CACHING_TYPE    *CacheType_
 
     m_ulDmaBufferSize = RequestedSize_;
 
+#if DBG
+    // Once per load, so the caching choice below can be checked on the part.
+    static LONG s_RingMeasured = 0;
+    if (0 == InterlockedExchange(&s_RingMeasured, 1))
+    {
+        MeasureRingCaching(RequestedSize_);
+    }
+#endif
+
     *AudioBufferMdl_ = pBufferMdl;
     *ActualSize_ = RequestedSize_;
     *OffsetFromFirstPage_ = 0;
-    *CacheType_ = MmNonCached;
+    *CacheType_ = DMA_BUFFER_CACHE_TYPE;
 
     return STATUS_SUCCESS;
 }
@@ -344,7 +448,7 @@ NTSTATUS CMiniportWaveRTStream::GetPosition
     KeAcquireSpinLock(&m_PositionSpinLock, &oldIrql);
 
     UINT64 linearPos;
-    m_pMiniport->CurrentPosition(NULL, &linearPos);
+    m_pMiniport->CurrentPosition(this, NULL, &linearPos);
     Position_->PlayOffset = linearPos;
     Position_->WriteOffset = linearPos/* + FIFO_SIZE*/;
 
@@ -355,6 +459,34 @@ NTSTATUS CMiniportWaveRTStream::GetPosition
     return ntStatus;
 }
 
+//=============================================================================
+#pragma code_seg("PAGE")
+NTSTATUS CMiniportWaveRTStream::SetCurrentWritePosition
+(
+    _In_    ULONG   WritePosition
+)
+{
+    PAGED_CODE();
+
+    if (WritePosition > m_ulDmaBufferSize)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    //
+    // The DSP stream only exists while running, remember the position so
+    // it can be handed over on the next transition to KSSTATE_RUN.
+    //
+    m_ulWritePosition = WritePosition;
+
+    if (m_KsState != KSSTATE_RUN)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    return m_pMiniport->SetWritePosition(this, WritePosition);
+}
+
 //=============================================================================
 #pragma code_seg()
 NTSTATUS CMiniportWaveRTStream::SetState
@@ -363,7 +495,6 @@ NTSTATUS CMiniportWaveRTStream::SetState
 )
 {
     NTSTATUS        ntStatus        = STATUS_SUCCESS;
-    KIRQL oldIrql;
 
     // Spew an event for a pin state change request from portcls
     //Event type: eMINIPORT_PIN_STATE
@@ -374,14 +505,8 @@ NTSTATUS CMiniportWaveRTStream::SetState
             {
                 // Acquire stream resources
             }
-            KeAcquireSpinLock(&m_PositionSpinLock, &oldIrql);
-
-            m_pMiniport->StopDMA();
-            if (!NT_SUCCESS(ntStatus)) {
-                return ntStatus;
-            }
-
-            KeReleaseSpinLock(&m_PositionSpinLock, oldIrql);
+            // stopping talks to the DSP over IPC, keep it out of the spinlock
+            m_pMiniport->StopDMA(this);
             break;
 
         case KSSTATE_ACQUIRE:
@@ -392,8 +517,8 @@ NTSTATUS CMiniportWaveRTStream::SetState
             break;
             
         case KSSTATE_PAUSE:
-            m_pMiniport->CurrentPosition(&m_lastLinkPos, &m_lastLinearPos);
-            m_pMiniport->StopDMA();
+            m_pMiniport->CurrentPosition(this, &m_lastLinkPos, &m_lastLinearPos);
+            m_pMiniport->StopDMA(this);
             break;
 
         case KSSTATE_RUN:
@@ -403,11 +528,15 @@ NTSTATUS CMiniportWaveRTStream::SetState
                 return ntStatus;
             }
 
-            m_pMiniport->StartDMA();
+            m_pMiniport->StartDMA(this);
             if (!NT_SUCCESS(ntStatus)) {
                 return ntStatus;
             }
 
+            if (m_ulWritePosition) {
+                m_pMiniport->SetWritePosition(this, m_ulWritePosition);
+            }
+
             break;
     }
 
@@ -64,6 +64,11 @@ public:
         _In_  GUID                SignalProcessingMode
     );
 
+    NTSTATUS                    SetCurrentWritePosition
+    (
+        _In_  ULONG               WritePosition
+    );
+
     // Friends
     friend class                CMiniportWaveRT;
 protected:
@@ -76,6 +81,7 @@ protected:
     ULONG                       m_ulDmaMovementRate;
     PWAVEFORMATEXTENSIBLE       m_pWfExt;
     ULONG                       m_ulContentId;
+    ULONG                       m_ulWritePosition;
     KSPIN_LOCK                  m_PositionSpinLock;
     UINT32                      m_lastLinkPos;
     UINT64                      m_lastLinearPos;
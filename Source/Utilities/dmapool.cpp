@@ -0,0 +1,197 @@
+#include <ntddk.h>
+#include "dmapool.h"
+
+// Pool tag used for the free list
+#define DMAPOOL_POOLTAG             'LPMD'
+
+DmaPool::DmaPool() {
+	this->base = NULL;
+	this->baseAddr.QuadPart = 0;
+	this->nblocks = 0;
+
+	this->freeStack = NULL;
+	this->freeTop = 0;
+	KeInitializeSpinLock(&this->lock);
+
+	this->fwBase = NULL;
+	this->fwAddr.QuadPart = 0;
+	this->fwSize = 0;
+	this->fwImage = 0;
+
+	this->dxBase = NULL;
+	this->dxAddr.QuadPart = 0;
+}
+
+DmaPool::~DmaPool() {
+	if (this->dxBase) {
+		MmFreeContiguousMemory(this->dxBase);
+		this->dxBase = NULL;
+	}
+
+	if (this->fwBase) {
+		MmFreeContiguousMemory(this->fwBase);
+		this->fwBase = NULL;
+	}
+
+	if (this->base) {
+		MmFreeContiguousMemory(this->base);
+		this->base = NULL;
+	}
+
+	if (this->freeStack) {
+		ExFreePoolWithTag(this->freeStack, DMAPOOL_POOLTAG);
+		this->freeStack = NULL;
+	}
+}
+
+PVOID DmaPool::alloc_contiguous(SIZE_T size) {
+	PHYSICAL_ADDRESS maxAddr;
+	maxAddr.QuadPart = MAXULONG32;
+
+	return MmAllocateContiguousMemory(size, maxAddr);
+}
+
+NTSTATUS DmaPool::init(ULONG blocks, SIZE_T fwSize, SIZE_T dxSize) {
+	ULONG i;
+
+	this->freeStack = (ULONG*)ExAllocatePoolZero(NonPagedPool, blocks * sizeof(ULONG), DMAPOOL_POOLTAG);
+	if (!this->freeStack)
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+	this->base = (UINT8*)alloc_contiguous((SIZE_T)blocks * DMA_POOL_BLOCK_SIZE);
+	if (!this->base) {
+		DPF(D_ERROR, "Unable to reserve %lu contiguous blocks\n", blocks);
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+	this->baseAddr = MmGetPhysicalAddress(this->base);
+	this->nblocks = blocks;
+
+	/* hand out the lowest blocks first */
+	for (i = 0; i < blocks; i++)
+		this->freeStack[i] = blocks - 1 - i;
+	this->freeTop = blocks;
+
+	/* best effort, fw_region retries once the image size is known */
+	if (fwSize) {
+		this->fwBase = alloc_contiguous(fwSize);
+		if (this->fwBase) {
+			this->fwAddr = MmGetPhysicalAddress(this->fwBase);
+			this->fwSize = fwSize;
+		}
+	}
+
+	/* without it D3 falls back to a cold boot on resume */
+	if (dxSize) {
+		this->dxBase = alloc_contiguous(dxSize);
+		if (this->dxBase)
+			this->dxAddr = MmGetPhysicalAddress(this->dxBase);
+	}
+
+	return STATUS_SUCCESS;
+}
+
+PVOID DmaPool::alloc_block(PHYSICAL_ADDRESS* paddr) {
+	KIRQL oldIrql;
+	ULONG idx;
+
+	KeAcquireSpinLock(&this->lock, &oldIrql);
+	if (!this->freeTop) {
+		KeReleaseSpinLock(&this->lock, oldIrql);
+		DPF(D_ERROR, "DMA pool exhausted\n");
+		return NULL;
+	}
+	idx = this->freeStack[--this->freeTop];
+	KeReleaseSpinLock(&this->lock, oldIrql);
+
+	if (paddr)
+		paddr->QuadPart = this->baseAddr.QuadPart + (LONGLONG)idx * DMA_POOL_BLOCK_SIZE;
+	return this->base + (SIZE_T)idx * DMA_POOL_BLOCK_SIZE;
+}
+
+void DmaPool::free_block(PVOID vaddr) {
+	KIRQL oldIrql;
+	SIZE_T off;
+
+	if (!vaddr)
+		return;
+
+	off = (UINT8*)vaddr - this->base;
+	if ((UINT8*)vaddr < this->base || off >= (SIZE_T)this->nblocks * DMA_POOL_BLOCK_SIZE ||
+		off % DMA_POOL_BLOCK_SIZE) {
+		DPF(D_ERROR, "Freeing %p which is not a pool block\n", vaddr);
+		return;
+	}
+
+	KeAcquireSpinLock(&this->lock, &oldIrql);
+	ASSERT(this->freeTop < this->nblocks);
+	this->freeStack[this->freeTop++] = (ULONG)(off / DMA_POOL_BLOCK_SIZE);
+	KeReleaseSpinLock(&this->lock, oldIrql);
+}
+
+/*
+ * Staging area for a fresh image, whatever was cached in it is gone. Only
+ * one image is staged at a time (boot or restore), so the region is simply
+ * reused. It is grown at most once, when the first image is larger than
+ * the reservation.
+ */
+PVOID DmaPool::fw_region(SIZE_T size, PHYSICAL_ADDRESS* paddr) {
+	this->fwImage = 0;
+
+	if (size > this->fwSize) {
+		if (this->fwBase)
+			MmFreeContiguousMemory(this->fwBase);
+
+		this->fwBase = alloc_contiguous(size);
+		if (!this->fwBase) {
+			this->fwSize = 0;
+			return NULL;
+		}
+		this->fwAddr = MmGetPhysicalAddress(this->fwBase);
+		this->fwSize = size;
+	}
+
+	if (paddr)
+		*paddr = this->fwAddr;
+	return this->fwBase;
+}
+
+/* The image kept from an earlier boot, NULL if it has to be read again */
+PVOID DmaPool::fw_image(SIZE_T* size, PHYSICAL_ADDRESS* paddr) {
+	if (!this->fwImage)
+		return NULL;
+
+	*size = this->fwImage;
+	if (paddr)
+		*paddr = this->fwAddr;
+	return this->fwBase;
+}
+
+/*
+ * Called once an image in the region booted. Within the budget it is kept
+ * for the next boot, otherwise the region goes back to the memory manager.
+ */
+void DmaPool::fw_keep(SIZE_T size) {
+	if (size <= DMA_POOL_FW_RESIDENT_MAX) {
+		this->fwImage = size;
+		return;
+	}
+
+	this->fwImage = 0;
+	if (this->fwBase) {
+		MmFreeContiguousMemory(this->fwBase);
+		this->fwBase = NULL;
+	}
+	this->fwAddr.QuadPart = 0;
+	this->fwSize = 0;
+}
+
+/* Forget the cached image, the region itself stays reserved */
+void DmaPool::fw_drop() {
+	this->fwImage = 0;
+}
+
+PVOID DmaPool::dx_region(PHYSICAL_ADDRESS* paddr) {
+	if (paddr)
+		*paddr = this->dxAddr;
+	return this->dxBase;
+}
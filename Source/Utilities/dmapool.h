@@ -0,0 +1,60 @@
+#pragma once
+#include "definitions.h"
+
+/*
+ * Driver-owned contiguous memory below 4GB. Reserved once when the device
+ * starts so stream starts and D0 resumes never go back to the memory
+ * manager for contiguous pages.
+ */
+#define DMA_POOL_BLOCK_SIZE	PAGE_SIZE
+/*
+ * Ring page tables (one per DSP stream) plus LLI pages for dw_dma, enough
+ * for the copy running and one queued behind it; checked in hw.cpp.
+ */
+#define DMA_POOL_BLOCKS		40
+/* initial size of the firmware staging area, grown once if too small */
+#define DMA_POOL_FW_SIZE	(256 * 1024)
+/* images up to this size stay resident between boots, larger ones are reread */
+#define DMA_POOL_FW_RESIDENT_MAX	(1024 * 1024)
+
+class DmaPool {
+public:
+	DmaPool();
+	~DmaPool();
+
+	NTSTATUS init(ULONG blocks, SIZE_T fwSize, SIZE_T dxSize);
+
+	PVOID alloc_block(PHYSICAL_ADDRESS* paddr);
+	void free_block(PVOID vaddr);
+
+	PVOID fw_region(SIZE_T size, PHYSICAL_ADDRESS* paddr);
+	PVOID fw_image(SIZE_T* size, PHYSICAL_ADDRESS* paddr);
+	void fw_keep(SIZE_T size);
+	void fw_drop();
+
+	PVOID dx_region(PHYSICAL_ADDRESS* paddr);
+private:
+	/* fixed size blocks, carved out of one contiguous range */
+	UINT8* base;
+	PHYSICAL_ADDRESS baseAddr;
+	ULONG nblocks;
+
+	/* indices of free blocks, top of stack is the next one handed out */
+	ULONG* freeStack;
+	ULONG freeTop;
+	KSPIN_LOCK lock;
+
+	/* firmware image copy, kept across boots */
+	PVOID fwBase;
+	PHYSICAL_ADDRESS fwAddr;
+	SIZE_T fwSize;
+	/* bytes of a loaded image still valid in the region, 0 if none */
+	SIZE_T fwImage;
+
+	/* DSP context saved across D3, as large as the DRAM */
+	PVOID dxBase;
+	PHYSICAL_ADDRESS dxAddr;
+
+	PVOID alloc_contiguous(SIZE_T size);
+};
+typedef DmaPool* PDmaPool;
@@ -1,24 +1,26 @@
 #include "definitions.h"
 #include "hw.h"
+#include "resource.h"
 #include "pa2xxssp.h"
 
 #if USESSTHW
-NTSTATUS CCsAudioCatptSSTHW::dsp_select_lpclock(BOOL lp, BOOL waiti)
+/* clk_mutex held */
+NTSTATUS CCsAudioCatptSSTHW::dsp_switch_lpclock(BOOL lp, BOOL waiti)
 {
 	UINT32 mask, reg, val;
+	ULONGLONG start;
+	ULONG64 qpc;
 	int ret;
 
-	ExAcquireFastMutex(&clk_mutex);
-
 	val = lp ? CATPT_CS_LPCS : 0;
 	reg = catpt_readl_shim(this, CS1) & CATPT_CS_LPCS;
 	CatPtPrint(DEBUG_LEVEL_VERBOSE, DBG_IOCTL, "LPCS [0x%08lx] 0x%08x -> 0x%08x",
 		CATPT_CS_LPCS, reg, val);
 
-	if (reg == val) {
-		ExReleaseFastMutex(&clk_mutex);
+	if (reg == val)
 		return STATUS_SUCCESS;
-	}
+
+	start = KeQueryInterruptTimePrecise(&qpc);
 
 	if (waiti) {
 		/* wait for DSP to signal WAIT state */
@@ -29,7 +31,7 @@ NTSTATUS CCsAudioCatptSSTHW::dsp_select_lpclock(BOOL lp, BOOL waiti)
 			DPF(D_ERROR, "await WAITI timeout\n");
 			/* no signal - only high clock selection allowed */
 			if (lp) {
-				ExReleaseFastMutex(&clk_mutex);
+				m_ClockStats.waitTime += KeQueryInterruptTimePrecise(&qpc) - start;
 				return STATUS_SUCCESS;
 			}
 		}
@@ -55,16 +57,104 @@ NTSTATUS CCsAudioCatptSSTHW::dsp_select_lpclock(BOOL lp, BOOL waiti)
 	/* update PLL accordingly */
 	catpt_updatel_pci_raw(this, this->spec->pll_shutdown_reg, this->spec->pll_shutdown_val, lp ? this->spec->pll_shutdown_val : 0);
 
-	ExReleaseFastMutex(&clk_mutex);
+	m_ClockStats.switches++;
+	m_ClockStats.waitTime += KeQueryInterruptTimePrecise(&qpc) - start;
 	return STATUS_SUCCESS;
 }
 
+NTSTATUS CCsAudioCatptSSTHW::dsp_select_lpclock(BOOL lp, BOOL waiti)
+{
+	NTSTATUS status;
+
+	ExAcquireFastMutex(&clk_mutex);
+	status = dsp_switch_lpclock(lp, waiti);
+	ExReleaseFastMutex(&clk_mutex);
+	return status;
+}
+
+/* a stream being set up is about to start, count it as load already */
+BOOL CCsAudioCatptSSTHW::dsp_clock_busy()
+{
+	int i;
+
+	for (i = 0; i < eMaxDeviceType; i++)
+		if (this->streams[i].allocated || this->streams[i].prepared)
+			return TRUE;
+
+	return FALSE;
+}
+
+/*
+ * Any stream load gets the high clock at once. Going back to low-power
+ * waits for lpclock_idle_ms without load, so bursts of short streams
+ * such as notification sounds keep the high clock instead of paying for
+ * a WAITI wait and two CLKCTL polls on every start and stop.
+ */
 NTSTATUS CCsAudioCatptSSTHW::dsp_update_lpclock()
 {
-	if (this->outStream.prepared || this->inStream.prepared)
-			return dsp_select_lpclock(false, true);
+	LARGE_INTEGER due;
+	NTSTATUS status = STATUS_SUCCESS;
+
+	ExAcquireFastMutex(&clk_mutex);
+	if (this->lpclock_off) {
+		/* flushed for power down, nothing is armed until the next boot */
+	} else if (dsp_clock_busy()) {
+		if (KeCancelTimer(&this->lpclock_timer))
+			m_ClockStats.held++;
+		status = dsp_switch_lpclock(false, true);
+	} else if (!this->lpclock_work || !this->lpclock_idle_ms) {
+		status = dsp_switch_lpclock(true, true);
+	} else {
+		due.QuadPart = -10000LL * this->lpclock_idle_ms;
+		KeSetTimer(&this->lpclock_timer, due, &this->lpclock_dpc_obj);
+	}
+	ExReleaseFastMutex(&clk_mutex);
+	return status;
+}
+
+VOID NTAPI CCsAudioCatptSSTHW::lpclock_dpc(PKDPC Dpc, PVOID DeferredContext, PVOID SystemArgument1, PVOID SystemArgument2) {
+	UNREFERENCED_PARAMETER(Dpc);
+	UNREFERENCED_PARAMETER(SystemArgument1);
+	UNREFERENCED_PARAMETER(SystemArgument2);
+
+	CCsAudioCatptSSTHW* that = (CCsAudioCatptSSTHW*)DeferredContext;
+
+	/* the switch polls and sleeps, hand it to a worker */
+	if (InterlockedExchange(&that->lpclock_queued, 1))
+		return;
+	KeClearEvent(&that->lpclock_idle);
+	IoQueueWorkItem(that->lpclock_work, lpclock_worker, DelayedWorkQueue, that);
+}
+
+VOID CCsAudioCatptSSTHW::lpclock_worker(PDEVICE_OBJECT DeviceObject, PVOID Context) {
+	UNREFERENCED_PARAMETER(DeviceObject);
+
+	CCsAudioCatptSSTHW* that = (CCsAudioCatptSSTHW*)Context;
+
+	/* a stream may have come in since the timer fired */
+	ExAcquireFastMutex(&that->clk_mutex);
+	if (!that->lpclock_off && !that->dsp_clock_busy())
+		that->dsp_switch_lpclock(true, true);
+	ExReleaseFastMutex(&that->clk_mutex);
+
+	InterlockedExchange(&that->lpclock_queued, 0);
+	KeSetEvent(&that->lpclock_idle, IO_NO_INCREMENT, FALSE);
+}
+
+/* drop a pending low-power switch and wait out one already running */
+void CCsAudioCatptSSTHW::dsp_flush_lpclock()
+{
+	/* a late dsp_update_lpclock must not re-arm behind our back */
+	ExAcquireFastMutex(&clk_mutex);
+	this->lpclock_off = TRUE;
+	KeCancelTimer(&this->lpclock_timer);
+	ExReleaseFastMutex(&clk_mutex);
+
+	if (!this->lpclock_work)
+		return;
 
-	return dsp_select_lpclock(true, true);
+	KeFlushQueuedDpcs();
+	KeWaitForSingleObject(&this->lpclock_idle, Executive, KernelMode, FALSE, NULL);
 }
 
 /* bring registers to their defaults as HW won't reset itself */
@@ -148,6 +238,8 @@ void CCsAudioCatptSSTHW::dsp_update_srampge(PRESOURCE sram,
 	for (resVal = sram->child; resVal; resVal = resVal->sibling) {
 		UINT32 h, l;
 
+		if (resVal->flags & IORESOURCE_DISABLED)
+			continue;
 		h = (UINT32)((resVal->end - sram->start) / CATPT_MEMBLOCK_SIZE);
 		l = (UINT32)((resVal->start - sram->start) / CATPT_MEMBLOCK_SIZE);
 		newVal |= GENMASK(h, l);
@@ -190,6 +282,26 @@ NTSTATUS CCsAudioCatptSSTHW::dsp_reset(BOOL reset)
 		500, 10000);
 }
 
+/*
+ * Pull several SRAM windows back in one chain. sg[].src are absolute SRAM
+ * addresses, the DwDMA tells the direction by CATPT_DMA_DSP_ADDR_MASK so
+ * it is applied to a local copy, the caller's list is left untouched.
+ */
+NTSTATUS CCsAudioCatptSSTHW::dsp_dma_sg_fromdsp(const struct dw_dma_sg* sg, UINT32 count)
+{
+	struct dw_dma_sg local[CATPT_DMA_SG_MAX];
+
+	if (count > CATPT_DMA_SG_MAX)
+		return STATUS_INVALID_PARAMETER;
+
+	for (UINT32 i = 0; i < count; i++) {
+		local[i] = sg[i];
+		local[i].src |= CATPT_DMA_DSP_ADDR_MASK;
+	}
+
+	return this->dmac->transfer_dma_sg(local, count);
+}
+
 NTSTATUS CCsAudioCatptSSTHW::dsp_power_down()
 {
 	UINT32 mask, val;
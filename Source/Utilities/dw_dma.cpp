@@ -2,16 +2,37 @@
 #include "dw_dma.h"
 #include "bitops.h"
 #include "hw.h"
+#if DBG
+#include "dw_dma_model.h"
+#endif
 
 // Pool tag used for DMA allocations
 #define DWDMA_POOLTAG               'MDWD'  
 
-DwDMA::DwDMA(void* regs) {
+DwDMA::DwDMA(void* regs, DmaPool* pool, PINTERRUPTSYNC interruptSync) {
 	this->regs = regs;
+	this->pool = pool;
+	this->interruptSync = interruptSync;
 
 	this->pdata = NULL;
 	this->chan = NULL;
 	this->all_chan_mask = 0;
+	this->block_size = 0;
+	this->max_burst = 0;
+#if DBG
+	this->model = NULL;
+#endif
+
+	this->activeMask = 0;
+	this->xferStatus = STATUS_SUCCESS;
+	RtlZeroMemory(&this->errRegs, sizeof(this->errRegs));
+	KeInitializeDpc(&this->xferDpc, DwDMA::xfer_dpc, this);
+
+	KeInitializeSpinLock(&this->queueLock);
+	InitializeListHead(&this->queue);
+	this->current = NULL;
+	this->enabled = FALSE;
+	RtlZeroMemory(&this->stats, sizeof(this->stats));
 }
 
 NTSTATUS DwDMA::init() {
@@ -114,6 +135,11 @@ NTSTATUS DwDMA::init() {
 			dwc->nollp = !pdata->multi_block[i];
 			dwc->max_burst = pdata->max_burst[i] ? 0 : DW_DMA_MAX_BURST;
 		}
+
+		if (!i || dwc->block_size < this->block_size)
+			this->block_size = dwc->block_size;
+		if (!i || dwc->max_burst < this->max_burst)
+			this->max_burst = dwc->max_burst;
 	}
 
 	/* Clear all interrupts on all channels. */
@@ -130,9 +156,13 @@ err_pdata:
 }
 
 DwDMA::~DwDMA() {
+	this->activeMask = 0;
+	KeRemoveQueueDpc(&this->xferDpc);
+	KeFlushQueuedDpcs();
+
 	this->disable();
 
-	for (UINT32 i = 0; i < pdata->nr_channels; i++) {
+	for (UINT32 i = 0; this->chan && i < pdata->nr_channels; i++) {
 		struct dw_dma_chan* dwc = &this->chan[i];
 		channel_clear_bit(this, CH_EN, dwc->mask);
 	}
@@ -163,137 +193,308 @@ void DwDMA::enable() {
 	dma_writel(this, CFG, DW_CFG_DMA_EN);
 }
 
+/*
+ * Turn the controller off once the queue drains. Every channel has finished
+ * or been stopped by then, so unlike disable() there is nothing to wait for
+ * and this is safe from the DPC.
+ */
+void DwDMA::idle() {
+	dma_writel(this, CFG, 0);
+	this->enabled = FALSE;
+}
+
 UINT32 DwDMA::readl(PVOID addr) {
+#if DBG
+	if (this->model)
+		return this->model->readl((UINT32)((UINT8*)addr - (UINT8*)this->regs));
+#endif
 	UINT32 ret = *(UINT32*)addr;
 	//DbgPrint("Read from %p: 0x%x\n", addr, ret);
 	return ret;
 }
 
 void DwDMA::writel(UINT32 data, PVOID addr) {
+#if DBG
+	if (this->model) {
+		this->model->writel(data, (UINT32)((UINT8*)addr - (UINT8*)this->regs));
+		return;
+	}
+#endif
 	*(UINT32*)addr = data;
 	//DbgPrint("Write to %p: 0x%x\n", addr, data);
 }
 
-UINT32 DwDMA::bytes2block(struct dw_dma_chan* dwc, UINT32 bytes, unsigned int width, UINT32* len) {
-	UINT32 block;
+/*
+ * The DMA controller shares the LPE interrupt line. Only look at it while a
+ * transfer is in flight so IPC interrupts don't pay for the extra reads.
+ * A copy may be spread over several channels; it completes once all of
+ * them have, or as soon as any of them fails.
+ */
+BOOLEAN DwDMA::irq_handler() {
+	UINT32 active = (UINT32)this->activeMask;
+	UINT32 xfer, error, remaining;
+
+	if (!active)
+		return FALSE;
+
+	xfer = dma_readl(this, STATUS.XFER) & active;
+	error = dma_readl(this, STATUS.ERROR) & active;
+	if (!xfer && !error)
+		return FALSE;
+
+	if (error) {
+		for (UINT32 i = 0; i < this->pdata->nr_channels; i++) {
+			struct dw_dma_chan* dwc = &this->chan[i];
+			if (!(error & dwc->mask))
+				continue;
+
+			this->errRegs.sar = channel_readl(dwc, SAR);
+			this->errRegs.dar = channel_readl(dwc, DAR);
+			this->errRegs.llp = channel_readl(dwc, LLP);
+			this->errRegs.ctllo = channel_readl(dwc, CTL_LO);
+			this->errRegs.ctlhi = channel_readl(dwc, CTL_HI);
+			this->errRegs.cfglo = channel_readl(dwc, CFG_LO);
+			break;
+		}
 
-	if ((bytes >> width) > dwc->block_size) {
-		block = dwc->block_size;
-		*len = (UINT32)dwc->block_size << width;
+		/* one failed piece fails the whole copy, stop the other channels */
+		channel_clear_bit(this, CH_EN, active);
+		dma_writel(this, CLEAR.ERROR, error);
+		this->xferStatus = STATUS_DEVICE_DATA_ERROR;
+		remaining = 0;
 	}
 	else {
-		block = bytes >> width;
-		*len = bytes;
+		remaining = active & ~xfer;
 	}
+	dma_writel(this, CLEAR.XFER, xfer);
 
-	return block;
+	channel_clear_bit(this, MASK.XFER, active & ~remaining);
+	channel_clear_bit(this, MASK.ERROR, active & ~remaining);
+	this->activeMask = remaining;
+
+	if (!remaining) {
+		if (this->xferStatus == STATUS_PENDING)
+			this->xferStatus = STATUS_SUCCESS;
+		KeInsertQueueDpc(&this->xferDpc, NULL, NULL);
+	}
+	return TRUE;
 }
 
-NTSTATUS DwDMA::transfer_dma(UINT32 dest, UINT32 src, UINT32 len) {
-	this->enable();
-	struct dw_dma_chan* dwc = NULL;
-	for (UINT32 i = 0; i < this->pdata->nr_channels; i++) {
-		if (dma_readl(this, CH_EN) & this->chan[i].mask) {
-			DPF(D_ERROR, "Channel not idle!\n");
-		}
-		else {
-			dwc = &this->chan[i];
-			break;
-		}
+/*
+ * Nothing here waits, it runs at DIRQL under the interrupt lock. The
+ * channels themselves are stopped later by the destructor.
+ */
+void DwDMA::irq_quiesce() {
+	this->activeMask = 0;
+
+	channel_clear_bit(this, MASK.XFER, this->all_chan_mask);
+	channel_clear_bit(this, MASK.BLOCK, this->all_chan_mask);
+	channel_clear_bit(this, MASK.SRC_TRAN, this->all_chan_mask);
+	channel_clear_bit(this, MASK.DST_TRAN, this->all_chan_mask);
+	channel_clear_bit(this, MASK.ERROR, this->all_chan_mask);
+}
+
+/*
+ * Stop the channels of the running descriptor. Runs under the interrupt
+ * lock so the ISR cannot set activeMask back or complete the copy halfway
+ * through; the queue lock is held by the caller.
+ */
+NTSTATUS DwDMA::stop_current(PINTERRUPTSYNC InterruptSync, PVOID DynamicContext) {
+	UNREFERENCED_PARAMETER(InterruptSync);
+	DwDMA* that = (DwDMA*)DynamicContext;
+	UINT32 mask = that->current->mask;
+
+	that->activeMask = 0;
+	channel_clear_bit(that, MASK.XFER, mask);
+	channel_clear_bit(that, MASK.ERROR, mask);
+	channel_clear_bit(that, CH_EN, mask);
+	return STATUS_SUCCESS;
+}
+
+/*
+ * Retire the descriptor on the channels and start the next queued one. A
+ * stale run, queued before terminate() retired the descriptor, finds either
+ * no descriptor or one whose channels are still active and leaves it be.
+ */
+_Use_decl_annotations_
+VOID NTAPI DwDMA::xfer_dpc(PKDPC Dpc, PVOID DeferredContext, PVOID SystemArgument1, PVOID SystemArgument2) {
+	UNREFERENCED_PARAMETER(Dpc);
+	UNREFERENCED_PARAMETER(SystemArgument1);
+	UNREFERENCED_PARAMETER(SystemArgument2);
+
+	DwDMA* that = (DwDMA*)DeferredContext;
+	struct dw_dma_desc* desc;
+	NTSTATUS status;
+
+	KeAcquireSpinLockAtDpcLevel(&that->queueLock);
+	desc = that->current;
+	if (!desc || that->activeMask) {
+		KeReleaseSpinLockFromDpcLevel(&that->queueLock);
+		return;
 	}
 
-	if (!dwc) {
-		return STATUS_RESOURCE_IN_USE;
+	status = that->xferStatus;
+	if (status == STATUS_DEVICE_DATA_ERROR) {
+		DPF(D_ERROR, "DMA block error; SAR: 0x%x DAR: 0x%x LLP: 0x%x CTL: 0x%x:%08x CFG: 0x%x\n",
+			that->errRegs.sar,
+			that->errRegs.dar,
+			that->errRegs.llp,
+			that->errRegs.ctlhi,
+			that->errRegs.ctllo,
+			that->errRegs.cfglo);
+	}
+	else if (NT_SUCCESS(status) && (dma_readl(that, CH_EN) & desc->mask)) {
+		DPF(D_ERROR, "Channel not idle???\n");
+		channel_clear_bit(that, CH_EN, desc->mask);
+		status = STATUS_INTERNAL_ERROR;
 	}
 
-	UINT8 m_master = 0;
+	that->retire_desc(desc, status);
+	that->start_next();
+	KeReleaseSpinLockFromDpcLevel(&that->queueLock);
+
+	that->complete_desc(desc, status);
+}
 
-	UINT8 lms = DWC_LLP_LMS(m_master);
+UINT32 DwDMA::bytes2block(UINT32 bytes, unsigned int width, UINT32* len) {
+	UINT32 block;
 
-	UINT32 data_width = this->pdata->data_width[m_master];
+	if ((bytes >> width) > this->block_size) {
+		block = this->block_size;
+		*len = this->block_size << width;
+	}
+	else {
+		block = bytes >> width;
+		*len = bytes;
+	}
 
-	UINT32 src_width, dst_width;
-	src_width = dst_width = __ffs(data_width | src | dest | len);
+	return block;
+}
 
-	dwc->direction = DMA_MEM_TO_MEM;
+/* burst length in items to CTL.MSIZE, see enum dw_dma_msize */
+static UINT32 dw_dma_encode_maxburst(UINT32 maxburst)
+{
+	UINT32 msize = maxburst > 1 ? fls(maxburst) - 2 : 0;
 
-	UINT32 ctllo;
-	UINT32 ctlhi;
+	return msize > DW_DMA_MSIZE_256 ? DW_DMA_MSIZE_256 : msize;
+}
 
-	{
-		//prepare ctllo
-		UINT8 smsize = (dwc->direction == DMA_DEV_TO_MEM) ? 3 : 0; //src_maxburst (DMA_DEV_MEM_TO_MEM) [16 -> 3]
-		UINT8 dmsize = (dwc->direction == DMA_MEM_TO_DEV) ? 3 : 0; //dst_maxburst (DMA_DEV_MEM_TO_DEV) [16 -> 3]
-		UINT8 p_master = 0;
-		UINT8 dms = (dwc->direction == DMA_MEM_TO_DEV) ? p_master : m_master;
-		UINT8 sms = (dwc->direction == DMA_DEV_TO_MEM) ? p_master : m_master;
-
-		ctllo = DWC_CTLL_LLP_D_EN | DWC_CTLL_LLP_S_EN |
-			DWC_CTLL_DST_MSIZE(dmsize) | DWC_CTLL_SRC_MSIZE(smsize) |
-			DWC_CTLL_DMS(dms) | DWC_CTLL_SMS(sms);
-	}
-	ctllo = ctllo | DWC_CTLL_DST_WIDTH(dst_width)
-		| DWC_CTLL_SRC_WIDTH(src_width)
-		| DWC_CTLL_DST_INC
-		| DWC_CTLL_SRC_INC
-		| DWC_CTLL_FC_M2M;
+UINT32 DwDMA::prepare_ctllo() {
+	UINT8 m_master = 0;
+	UINT32 msize = dw_dma_encode_maxburst(this->max_burst);
+
+	/*
+	 * Both ends of a memcpy sit behind master 0 on the LPE, the DSP SRAM
+	 * is reached through the same AHB port as host memory.
+	 */
+	return DWC_CTLL_LLP_D_EN | DWC_CTLL_LLP_S_EN |
+		DWC_CTLL_DST_MSIZE(msize) | DWC_CTLL_SRC_MSIZE(msize) |
+		DWC_CTLL_DMS(m_master) | DWC_CTLL_SMS(m_master) |
+		DWC_CTLL_DST_INC | DWC_CTLL_SRC_INC | DWC_CTLL_FC_M2M;
+}
 
+/*
+ * Queue one contiguous copy on the chain. The widest transfer width both
+ * ends can share is limited by their relative misalignment, so the copy is
+ * cut into a short head up to that alignment, a body moved at full width
+ * and max burst, and whatever tail is left. Without this one odd address
+ * or length would drop the whole copy to byte transfers.
+ */
+NTSTATUS DwDMA::chain_append(struct dw_dma_chain* chain, UINT32 dest, UINT32 src, UINT32 len) {
+	UINT32 align = this->pdata->data_width[0];
+	UINT32 head, body;
 	NTSTATUS status;
 
-	PHYSICAL_ADDRESS maxAddr;
-	maxAddr.QuadPart = MAXULONG32;
-	UINT8* vaddr;
-	vaddr = (UINT8 *)MmAllocateContiguousMemory(0x1000, maxAddr);
-	if (!vaddr) {
-		status = STATUS_NO_MEMORY;
-		goto err;
-	}
+	if ((src ^ dest) & (align - 1))
+		align = 1 << __ffs(src ^ dest);
 
-	RtlZeroMemory(vaddr, 0x1000);
+	head = (align - (src & (align - 1))) & (align - 1);
+	if (head > len)
+		head = len;
+	body = (len - head) & ~(align - 1);
+
+	if (head) {
+		status = chain_append_piece(chain, dest, src, head);
+		if (!NT_SUCCESS(status))
+			return status;
+	}
+	if (body) {
+		status = chain_append_piece(chain, dest + head, src + head, body);
+		if (!NT_SUCCESS(status))
+			return status;
+	}
+	if (len - head - body)
+		return chain_append_piece(chain, dest + head + body, src + head + body, len - head - body);
+	return STATUS_SUCCESS;
+}
 
-	UINT8* curVaddr;
-	curVaddr = vaddr;
+/* Split one equally aligned piece into LLIs at the end of the chain */
+NTSTATUS DwDMA::chain_append_piece(struct dw_dma_chain* chain, UINT32 dest, UINT32 src, UINT32 len) {
+	UINT8 lms = DWC_LLP_LMS(0);
+	UINT32 data_width = this->pdata->data_width[0];
 
-	struct dw_lli* prev;
-	prev = NULL;
+	UINT32 width = __ffs(data_width | src | dest | len);
+	UINT32 ctllo = prepare_ctllo() | DWC_CTLL_DST_WIDTH(width) | DWC_CTLL_SRC_WIDTH(width);
 
 	UINT32 xfer_count, offset;
 	for (offset = 0; offset < len; offset += xfer_count) {
-		ctlhi = this->bytes2block(dwc, len - offset, src_width, &xfer_count);
+		UINT32 ctlhi = this->bytes2block(len - offset, width, &xfer_count);
 
-		//write sar, dar, ctllo, ctlhi
-		struct dw_lli* cur = (struct dw_lli*)curVaddr;
-		if (curVaddr + sizeof(struct dw_lli) > vaddr + 0x1000) {
-			status = STATUS_NO_MEMORY;
-			DPF(D_ERROR, "Unable to get lli entry\n");
-			goto err;
+		/* LLIs live in pool blocks, a new block is chained in when one fills up */
+		if (chain->cur + sizeof(struct dw_lli) > chain->end) {
+			PHYSICAL_ADDRESS pageAddr;
+
+			if (chain->npages == DW_DMA_MAX_LLI_PAGES) {
+				DPF(D_ERROR, "Unable to get lli entry\n");
+				return STATUS_NO_MEMORY;
+			}
+
+			chain->cur = (UINT8*)this->pool->alloc_block(&pageAddr);
+			if (!chain->cur)
+				return STATUS_NO_MEMORY;
+			RtlZeroMemory(chain->cur, DMA_POOL_BLOCK_SIZE);
+			chain->end = chain->cur + DMA_POOL_BLOCK_SIZE;
+			chain->pages[chain->npages++] = chain->cur;
+			if (chain->npages == 1)
+				chain->first = pageAddr;
 		}
 
+		//write sar, dar, ctllo, ctlhi
+		struct dw_lli* cur = (struct dw_lli*)chain->cur;
+
 		cur->sar = (UINT32)(src + offset);
 		cur->dar = (UINT32)(dest + offset);
 		cur->ctllo = ctllo;
 		cur->ctlhi = ctlhi;
 		cur->llp = 0;
 
-		if (prev) {
+		if (chain->prev) {
 			PHYSICAL_ADDRESS paddr;
 			paddr = MmGetPhysicalAddress(cur);
 
-			prev->llp = paddr.LowPart | lms;
+			chain->prev->llp = paddr.LowPart | lms;
 		}
-		prev = cur;
+		chain->prev = cur;
 
-		curVaddr += sizeof(struct dw_lli);
+		chain->cur += sizeof(struct dw_lli);
 	}
 
-	if (prev) {
-		prev->ctllo &= ~(DWC_CTLL_LLP_D_EN | DWC_CTLL_LLP_S_EN);
+	chain->len += len;
+	return STATUS_SUCCESS;
+}
+
+void DwDMA::chain_free(struct dw_dma_chain* chain) {
+	for (UINT32 i = 0; i < chain->npages; i++) {
+		this->pool->free_block(chain->pages[i]);
 	}
+	chain->npages = 0;
+}
 
-	PHYSICAL_ADDRESS paddr;
-	paddr = MmGetPhysicalAddress(vaddr);
+/* Program the chain's channel to start at its first LLI; CH_EN is set by the caller */
+void DwDMA::chain_start(struct dw_dma_chain* chain) {
+	struct dw_dma_chan* dwc = chain->dwc;
+	UINT8 lms = DWC_LLP_LMS(0);
 
-	//Begin start transfer
 	{
 		//Initialize channel
 
@@ -313,56 +514,326 @@ NTSTATUS DwDMA::transfer_dma(UINT32 dest, UINT32 src, UINT32 len) {
 	}
 
 	/* Enable interrupts */
+	dma_writel(this, CLEAR.XFER, dwc->mask);
+	dma_writel(this, CLEAR.ERROR, dwc->mask);
 	channel_set_bit(this, MASK.XFER, dwc->mask);
 	channel_set_bit(this, MASK.ERROR, dwc->mask);
 
-	channel_writel(dwc, LLP, paddr.LowPart | lms);
+	channel_writel(dwc, LLP, chain->first.LowPart | lms);
 	channel_writel(dwc, CTL_LO, DWC_CTLL_LLP_D_EN | DWC_CTLL_LLP_S_EN);
 	channel_writel(dwc, CTL_HI, 0);
-	channel_set_bit(this, CH_EN, dwc->mask);
-
-	LARGE_INTEGER Start;
-	KeQuerySystemTimePrecise(&Start);
-
-	//Check status
-	while (true) {
-		LARGE_INTEGER Cur;
-		KeQuerySystemTimePrecise(&Cur);
-
-		if (Cur.QuadPart - Start.QuadPart > 10 * 1000 * 1000 * 1) {
-			CatPtPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "Timed out!\n");
-			CatPtPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "Regs; SAR: 0x%x DAR: 0x%x LLP: 0x%x CTL: 0x%x:%08x\n",
-				channel_readl(dwc, SAR),
-				channel_readl(dwc, DAR),
-				channel_readl(dwc, LLP),
-				channel_readl(dwc, CTL_HI),
-				channel_readl(dwc, CTL_LO));
-			status = STATUS_TIMEOUT;
-			break;
-		}
+}
 
-		UINT32 status_xfer = dma_readl(this, RAW.XFER);
-		if (status_xfer & dwc->mask) {
-			dma_writel(this, CLEAR.XFER, dwc->mask);
-			if (dma_readl(this, CH_EN) & dwc->mask) {
-				DPF(D_ERROR, "Channel not idle???\n");
-				status = STATUS_INTERNAL_ERROR;
-			}
-			else {
-				status = STATUS_SUCCESS;
+NTSTATUS DwDMA::transfer_dma(UINT32 dest, UINT32 src, UINT32 len) {
+	struct dw_dma_sg sg;
+
+	sg.dst = dest;
+	sg.src = src;
+	sg.len = len;
+	return this->transfer_dma_sg(&sg, 1);
+}
+
+/*
+ * Build the LLI chains for a copy. Large copies are cut into equal shares,
+ * up to DW_DMA_MAX_PARALLEL of them, each a single LLI chain; start_desc()
+ * spreads them over whichever channels are idle when the copy starts. A
+ * prepared descriptor must be passed to submit(), the callback then runs
+ * at DISPATCH_LEVEL once the copy has finished or failed. The one user is
+ * transfer_dma_sg(), which waits for that callback.
+ */
+NTSTATUS DwDMA::prepare(struct dw_dma_desc* desc, const struct dw_dma_sg* sg, UINT32 count,
+	DW_DMA_CALLBACK* callback, PVOID context) {
+	UINT32 share, filled, c;
+	NTSTATUS status = STATUS_SUCCESS;
+
+	RtlZeroMemory(desc, sizeof(*desc));
+	desc->callback = callback;
+	desc->context = context;
+
+	for (UINT32 s = 0; s < count; s++)
+		desc->total += sg[s].len;
+	if (!desc->total)
+		return STATUS_INVALID_PARAMETER;
+
+	desc->nchains = 1;
+	if (desc->total >= DW_DMA_SPLIT_MIN)
+		desc->nchains = min((UINT32)DW_DMA_MAX_PARALLEL, this->pdata->nr_channels);
+
+	/* keep the cut points aligned so no piece drops to a narrower width */
+	share = ((desc->total + desc->nchains - 1) / desc->nchains + DW_DMA_SPLIT_ALIGN - 1) & ~(DW_DMA_SPLIT_ALIGN - 1);
+
+	c = 0;
+	filled = 0;
+	for (UINT32 s = 0; s < count; s++) {
+		UINT32 off = 0;
+
+		while (off < sg[s].len) {
+			UINT32 piece = sg[s].len - off;
+			if (c + 1 < desc->nchains && piece > share - filled)
+				piece = share - filled;
+
+			status = chain_append(&desc->chains[c], sg[s].dst + off, sg[s].src + off, piece);
+			if (!NT_SUCCESS(status))
+				goto err;
+
+			off += piece;
+			filled += piece;
+			if (filled >= share && c + 1 < desc->nchains) {
+				c++;
+				filled = 0;
 			}
-			break;
 		}
-
-		LARGE_INTEGER Interval;
-		Interval.QuadPart = -10 * 10;
-		KeDelayExecutionThread(KernelMode, false, &Interval);
 	}
 
+	return STATUS_SUCCESS;
+
 err:
-	if (vaddr) {
-		MmFreeContiguousMemory(vaddr);
+	for (UINT32 i = 0; i < desc->nchains; i++) {
+		chain_free(&desc->chains[i]);
 	}
-	this->disable();
 	return status;
-}
\ No newline at end of file
+}
+
+/*
+ * Queue a prepared descriptor, callable at IRQL <= DISPATCH_LEVEL.
+ * Descriptors run one after the other in submission order and the
+ * controller stays enabled until the queue is empty.
+ */
+void DwDMA::submit(struct dw_dma_desc* desc) {
+	KIRQL irql;
+
+	KeAcquireSpinLock(&this->queueLock, &irql);
+	this->stats.queueDepth++;
+	if (this->stats.queueDepth > this->stats.maxQueueDepth)
+		this->stats.maxQueueDepth = this->stats.queueDepth;
+
+	if (!this->current)
+		start_desc(desc);
+	else
+		InsertTailList(&this->queue, &desc->entry);
+	KeReleaseSpinLock(&this->queueLock, irql);
+}
+
+/*
+ * Pull a submitted descriptor back, stopping its channels if it is the one
+ * running. Returns FALSE if it already completed, in which case its
+ * callback has run or is about to; otherwise the callback is never called.
+ */
+BOOLEAN DwDMA::terminate(struct dw_dma_desc* desc) {
+	KIRQL irql;
+	BOOLEAN found = FALSE;
+
+	KeAcquireSpinLock(&this->queueLock, &irql);
+	if (this->current == desc) {
+		if (this->interruptSync)
+			this->interruptSync->CallSynchronizedRoutine(DwDMA::stop_current, this);
+		else
+			DwDMA::stop_current(NULL, this);
+
+		retire_desc(desc, STATUS_IO_TIMEOUT);
+		start_next();
+		found = TRUE;
+	}
+	else {
+		for (PLIST_ENTRY entry = this->queue.Flink; entry != &this->queue; entry = entry->Flink) {
+			if (entry != &desc->entry)
+				continue;
+
+			RemoveEntryList(entry);
+			this->stats.queueDepth--;
+			this->stats.failed++;
+			found = TRUE;
+			break;
+		}
+	}
+	KeReleaseSpinLock(&this->queueLock, irql);
+
+	if (found) {
+		for (UINT32 i = 0; i < desc->nchains; i++) {
+			chain_free(&desc->chains[i]);
+		}
+	}
+	return found;
+}
+
+void DwDMA::get_stats(struct dw_dma_stats* stats) {
+	KIRQL irql;
+
+	KeAcquireSpinLock(&this->queueLock, &irql);
+	*stats = this->stats;
+	KeReleaseSpinLock(&this->queueLock, irql);
+}
+
+/*
+ * Put the descriptor's chains on the channels idle right now and kick them,
+ * queue lock held. With fewer idle channels than chains, the chains sharing
+ * a channel are linked into one list and run back to back. With none the
+ * copy fails with STATUS_RESOURCE_IN_USE through the DPC, like any other.
+ */
+void DwDMA::start_desc(struct dw_dma_desc* desc) {
+	struct dw_dma_chan* slots[DW_DMA_MAX_PARALLEL];
+	struct dw_dma_chain* heads[DW_DMA_MAX_PARALLEL];
+	struct dw_dma_chain* tails[DW_DMA_MAX_PARALLEL];
+	UINT32 busy, nslots = 0, s = 0;
+	UINT8 lms = DWC_LLP_LMS(0);
+
+	this->current = desc;
+	desc->started = KeQueryInterruptTime();
+	desc->mask = 0;
+
+	busy = dma_readl(this, CH_EN);
+	for (UINT32 i = 0; i < this->pdata->nr_channels && nslots < desc->nchains; i++) {
+		if (busy & this->chan[i].mask)
+			continue;
+		this->chan[i].direction = DMA_MEM_TO_MEM;
+		heads[nslots] = tails[nslots] = NULL;
+		slots[nslots++] = &this->chan[i];
+	}
+
+	if (!nslots) {
+		DPF(D_ERROR, "Channel not idle!\n");
+		this->xferStatus = STATUS_RESOURCE_IN_USE;
+		KeInsertQueueDpc(&this->xferDpc, NULL, NULL);
+		return;
+	}
+
+	for (UINT32 i = 0; i < desc->nchains; i++) {
+		struct dw_dma_chain* chain = &desc->chains[i];
+		if (!chain->len)
+			continue;
+
+		chain->dwc = slots[s];
+		if (tails[s])
+			tails[s]->prev->llp = chain->first.LowPart | lms;
+		else
+			heads[s] = chain;
+		tails[s] = chain;
+		s = (s + 1) % nslots;
+	}
+
+	if (!this->enabled) {
+		this->enable();
+		this->enabled = TRUE;
+	}
+	this->xferStatus = STATUS_PENDING;
+
+	/* Completion comes back through irq_handler */
+	for (s = 0; s < nslots; s++) {
+		if (!heads[s])
+			continue;
+
+		/* last LLI on the channel ends its list */
+		tails[s]->prev->ctllo &= ~(DWC_CTLL_LLP_D_EN | DWC_CTLL_LLP_S_EN);
+		chain_start(heads[s]);
+		desc->mask |= slots[s]->mask;
+	}
+
+	InterlockedExchange(&this->activeMask, desc->mask);
+	channel_set_bit(this, CH_EN, desc->mask);
+}
+
+/* Queue lock held */
+void DwDMA::start_next() {
+	PLIST_ENTRY entry;
+
+	if (IsListEmpty(&this->queue)) {
+		this->idle();
+		return;
+	}
+
+	entry = RemoveHeadList(&this->queue);
+	start_desc(CONTAINING_RECORD(entry, struct dw_dma_desc, entry));
+}
+
+/* Account for the descriptor leaving the channels, queue lock held */
+void DwDMA::retire_desc(struct dw_dma_desc* desc, NTSTATUS status) {
+	this->current = NULL;
+	this->stats.queueDepth--;
+	this->stats.busyTime += KeQueryInterruptTime() - desc->started;
+	if (NT_SUCCESS(status)) {
+		this->stats.completed++;
+		this->stats.bytes += desc->total;
+	}
+	else {
+		this->stats.failed++;
+	}
+}
+
+/* Hand a retired descriptor back to its owner, called without the lock */
+void DwDMA::complete_desc(struct dw_dma_desc* desc, NTSTATUS status) {
+	for (UINT32 i = 0; i < desc->nchains; i++) {
+		chain_free(&desc->chains[i]);
+	}
+
+	if (desc->callback)
+		desc->callback(desc, status, desc->context);
+}
+
+struct dw_dma_sync {
+	KEVENT done;
+	NTSTATUS status;
+};
+
+static VOID dw_dma_sync_complete(struct dw_dma_desc* desc, NTSTATUS status, PVOID context) {
+	struct dw_dma_sync* sync = (struct dw_dma_sync*)context;
+
+	UNREFERENCED_PARAMETER(desc);
+
+	sync->status = status;
+	KeSetEvent(&sync->done, IO_NO_INCREMENT, FALSE);
+}
+
+/* Blocking copy on top of the queue, PASSIVE_LEVEL only */
+NTSTATUS DwDMA::transfer_dma_sg(const struct dw_dma_sg* sg, UINT32 count) {
+	struct dw_dma_desc desc;
+	struct dw_dma_sync sync;
+	LARGE_INTEGER Timeout;
+	UINT32 total = 0;
+	NTSTATUS status;
+
+	for (UINT32 s = 0; s < count; s++)
+		total += sg[s].len;
+	if (!total)
+		return STATUS_SUCCESS;
+
+	KeInitializeEvent(&sync.done, NotificationEvent, FALSE);
+	sync.status = STATUS_PENDING;
+
+	status = prepare(&desc, sg, count, dw_dma_sync_complete, &sync);
+	if (!NT_SUCCESS(status))
+		return status;
+
+	this->submit(&desc);
+
+	/* the chains may end up sharing one channel */
+	Timeout.QuadPart = -10LL * 1000 * DW_DMA_TIMEOUT_MS(desc.total);
+	for (;;) {
+		status = KeWaitForSingleObject(&sync.done, Executive, KernelMode, FALSE, &Timeout);
+		if (status != STATUS_TIMEOUT)
+			break;
+
+		/* the budget only counts once the copy is on the channels */
+		if (!desc.started)
+			continue;
+
+		if (this->terminate(&desc)) {
+			struct dw_dma_chan* dwc = desc.chains[0].dwc;
+
+			/* the stopped channel keeps its registers */
+			if (dwc)
+				DPF(D_ERROR, "DMA of 0x%x bytes on channels 0x%x timed out; SAR: 0x%x DAR: 0x%x LLP: 0x%x CTL: 0x%x:%08x\n",
+					desc.total, desc.mask,
+					channel_readl(dwc, SAR),
+					channel_readl(dwc, DAR),
+					channel_readl(dwc, LLP),
+					channel_readl(dwc, CTL_HI),
+					channel_readl(dwc, CTL_LO));
+			return STATUS_IO_TIMEOUT;
+		}
+
+		/* it completed while timing out */
+		KeWaitForSingleObject(&sync.done, Executive, KernelMode, FALSE, NULL);
+		break;
+	}
+	return sync.status;
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "definitions.h"
+#include "dmapool.h"
 
 #define DW_DMA_MAX_NR_MASTERS	4
 #define DW_DMA_MAX_NR_CHANNELS	8
@@ -349,35 +350,163 @@ struct dw_lli {
 	UINT32 dstat;
 };
 
+/* channel state captured by the ISR when a block fails */
+struct dw_dma_err_regs {
+	UINT32 sar;
+	UINT32 dar;
+	UINT32 llp;
+	UINT32 ctllo;
+	UINT32 ctlhi;
+	UINT32 cfglo;
+};
+
+/* one contiguous piece of a scatter-gather copy */
+struct dw_dma_sg {
+	UINT32 dst;
+	UINT32 src;
+	UINT32 len;
+};
+
+/* LLI pages a single chain may span, 146 LLIs per page */
+#define DW_DMA_MAX_LLI_PAGES	4
+
+/* copies at least this large are spread over several idle channels */
+#define DW_DMA_SPLIT_MIN	(64 * 1024)
+#define DW_DMA_MAX_PARALLEL	4
+#define DW_DMA_SPLIT_ALIGN	64
+
+/* LLI chain for one share of a copy, given a channel when it starts */
+struct dw_dma_chain {
+	struct dw_dma_chan* dwc;
+	UINT8* pages[DW_DMA_MAX_LLI_PAGES];
+	UINT32 npages;
+	PHYSICAL_ADDRESS first;
+	struct dw_lli* prev;
+	UINT8* cur;
+	UINT8* end;
+	UINT32 len;
+};
+
+struct dw_dma_desc;
+#if DBG
+class DwDMAModel;
+#endif
+
+/* runs at DISPATCH_LEVEL, the descriptor may be reused from here on */
+typedef VOID DW_DMA_CALLBACK(struct dw_dma_desc* desc, NTSTATUS status, PVOID context);
+
+/* one queued copy, owned by the caller until its callback has run */
+struct dw_dma_desc {
+	LIST_ENTRY entry;
+	struct dw_dma_chain chains[DW_DMA_MAX_PARALLEL];
+	UINT32 nchains;
+	UINT32 mask;		/* channels it runs on, set once started */
+	UINT32 total;
+	ULONGLONG started;
+	DW_DMA_CALLBACK* callback;
+	PVOID context;
+};
+
+/* queue and throughput counters */
+struct dw_dma_stats {
+	UINT32 queueDepth;	/* submitted but not yet completed */
+	UINT32 maxQueueDepth;
+	UINT64 completed;
+	UINT64 failed;
+	UINT64 bytes;		/* copied by completed descriptors */
+	UINT64 busyTime;	/* 100ns units a descriptor sat on the channels */
+};
+
+/* completion budget: fixed setup slack plus 1ms per 64KB */
+#define DW_DMA_TIMEOUT_MS(len)	(20 + ((len) >> 16))
+
 class DwDMA {
 public:
 	void* regs;
 
-	DwDMA(void* regs);
+	DwDMA(void* regs, DmaPool* pool, PINTERRUPTSYNC interruptSync);
 	~DwDMA();
 
 	NTSTATUS init();
+
+	/* called from the LPE ISR, returns TRUE if the DMA raised the interrupt */
+	BOOLEAN irq_handler();
+	/* mask every channel interrupt, called synchronized with the ISR */
+	void irq_quiesce();
+#if DBG
+	/* registers are reached through this instead of regs when set */
+	DwDMAModel* model;
+#endif
 private:
+	/* completion of the transfer in flight, retired from xfer_dpc */
+	KDPC xferDpc;
+	volatile LONG activeMask;
+	NTSTATUS xferStatus;
+	struct dw_dma_err_regs errRegs;
+
+	static KDEFERRED_ROUTINE xfer_dpc;
+
+	/* the LPE interrupt irq_handler runs under, NULL if not connected */
+	PINTERRUPTSYNC interruptSync;
+	static NTSTATUS stop_current(PINTERRUPTSYNC InterruptSync, PVOID DynamicContext);
+
+	/* submitted descriptors waiting for the one in flight */
+	KSPIN_LOCK queueLock;
+	LIST_ENTRY queue;
+	struct dw_dma_desc* current;
+	BOOLEAN enabled;
+	struct dw_dma_stats stats;
+
+	void start_desc(struct dw_dma_desc* desc);
+	void start_next();
+	void retire_desc(struct dw_dma_desc* desc, NTSTATUS status);
+	void complete_desc(struct dw_dma_desc* desc, NTSTATUS status);
+
 	struct dw_dma_chan* chan;
 
 	/* channels */
 	UINT8			all_chan_mask;
+	/* smallest over all channels, chains are built before one is picked */
+	UINT32			block_size;
+	UINT32			max_burst;
 
 	struct dw_dma_platform_data* pdata;
 
+	/* LLI pages come from here */
+	DmaPool* pool;
+
 	void disable();
 	void enable();
+	void idle();
+
+	UINT32 bytes2block(UINT32 bytes, unsigned int width, UINT32* len);
+	UINT32 prepare_ctllo();
 
-	UINT32 bytes2block(struct dw_dma_chan* dwc, UINT32 bytes, unsigned int width, UINT32* len);
+	NTSTATUS chain_append(struct dw_dma_chain* chain, UINT32 dest, UINT32 src, UINT32 len);
+	NTSTATUS chain_append_piece(struct dw_dma_chain* chain, UINT32 dest, UINT32 src, UINT32 len);
+	void chain_free(struct dw_dma_chain* chain);
+	void chain_start(struct dw_dma_chain* chain);
 
 	UINT32 readl(PVOID reg);
 	void writel(UINT32 val, PVOID reg);
 
 public:
+	NTSTATUS prepare(struct dw_dma_desc* desc, const struct dw_dma_sg* sg, UINT32 count,
+		DW_DMA_CALLBACK* callback, PVOID context);
+	void submit(struct dw_dma_desc* desc);
+	BOOLEAN terminate(struct dw_dma_desc* desc);
+	void get_stats(struct dw_dma_stats* stats);
+
 	NTSTATUS transfer_dma(UINT32 dest, UINT32 src, UINT32 len);
+	NTSTATUS transfer_dma_sg(const struct dw_dma_sg* sg, UINT32 count);
 };
 typedef DwDMA* PDwDMA;
 
+#if DBG
+/* run a DwDMA against DwDMAModel, see dw_dma_model.cpp */
+void dw_dma_model_check(DmaPool* pool);
+#endif
+
 static inline struct dw_dma_regs* __dw_regs(DwDMA* dw)
 {
 	return (struct dw_dma_regs *)dw->regs;
@@ -0,0 +1,508 @@
+#include <ntddk.h>
+#include "dw_dma_model.h"
+#include "bitops.h"
+
+#if DBG
+// Pool tag used for the model and the DwDMA instance driving it
+#define DWDMA_MODEL_POOLTAG         'MMWD'
+
+/* order of the registers in struct dw_dma_irq_regs */
+enum dw_dma_model_irq {
+	DW_MODEL_XFER,
+	DW_MODEL_BLOCK,
+	DW_MODEL_SRC_TRAN,
+	DW_MODEL_DST_TRAN,
+	DW_MODEL_ERROR,
+};
+
+#define DW_MODEL_REG(name)	((UINT32)FIELD_OFFSET(struct dw_dma_regs, name))
+#define DW_MODEL_CHAN_MASK	((1 << DW_DMA_MODEL_CHANNELS) - 1)
+/* DWC_PARAMS.MSIZE, max burst is 4 << 2 = 16 items */
+#define DW_MODEL_DWC_MSIZE	2
+/* MAX_BLK_SIZE nibble for 4095 items */
+#define DW_MODEL_BLK_SIZE	0xa
+
+DwDMAModel::DwDMAModel() {
+	RtlZeroMemory(&this->regs, sizeof(this->regs));
+	RtlZeroMemory(this->raw, sizeof(this->raw));
+	RtlZeroMemory(this->mask, sizeof(this->mask));
+	this->chEn = 0;
+	this->dw = NULL;
+
+	this->hold = FALSE;
+	this->busy = 0;
+	this->failAddr = 0;
+	this->arena = NULL;
+	this->arenaAddr = 0;
+	this->arenaSize = 0;
+	this->reset_stats();
+
+	/* encoded parameters, a data width of 0 encodes 4 bytes */
+	this->regs.DW_PARAMS = (1 << DW_PARAMS_EN) |
+		((DW_DMA_MODEL_CHANNELS - 1) << DW_PARAMS_NR_CHAN) |
+		((DW_DMA_MODEL_MASTERS - 1) << DW_PARAMS_NR_MASTER);
+	for (UINT32 i = 0; i < DW_DMA_MODEL_CHANNELS; i++) {
+		this->regs.DWC_PARAMS[i] = (1 << DWC_PARAMS_MBLK_EN) |
+			(DW_MODEL_DWC_MSIZE << DWC_PARAMS_MSIZE);
+		this->regs.MAX_BLK_SIZE |= (UINT32)DW_MODEL_BLK_SIZE << (4 * i);
+	}
+}
+
+void DwDMAModel::attach(DwDMA* dw) {
+	this->dw = dw;
+	dw->model = this;
+}
+
+void DwDMAModel::reset_stats() {
+	RtlZeroMemory(&this->stats, sizeof(this->stats));
+}
+
+UINT32 DwDMAModel::enabled_channels() {
+	return this->chEn;
+}
+
+/* offset of one register of a struct dw_dma_irq_regs group, skipping the pads */
+static BOOLEAN dw_model_irq_reg(UINT32 offset, UINT32 group, UINT32* idx)
+{
+	if (offset < group || offset >= group + sizeof(struct dw_dma_irq_regs) || (offset - group) % 8)
+		return FALSE;
+	*idx = (offset - group) / 8;
+	return TRUE;
+}
+
+/* channel_set_bit()/channel_clear_bit(): bits 8-15 enable writing bits 0-7 */
+static UINT32 dw_model_write_enable(UINT32 reg, UINT32 val)
+{
+	UINT32 we = (val >> 8) & 0xff;
+
+	return (reg & ~we) | (val & we);
+}
+
+UINT32 DwDMAModel::readl(UINT32 offset) {
+	UINT32 i;
+
+	ASSERT(offset < sizeof(this->regs) && !(offset & 3));
+	this->stats.reads++;
+
+	if (dw_model_irq_reg(offset, DW_MODEL_REG(RAW), &i))
+		return this->raw[i];
+	if (dw_model_irq_reg(offset, DW_MODEL_REG(STATUS), &i))
+		return this->raw[i] & this->mask[i];
+	if (dw_model_irq_reg(offset, DW_MODEL_REG(MASK), &i))
+		return this->mask[i];
+	if (offset == DW_MODEL_REG(CH_EN))
+		return this->chEn | this->busy;
+	return *(UINT32*)((UINT8*)&this->regs + offset);
+}
+
+void DwDMAModel::writel(UINT32 val, UINT32 offset) {
+	UINT32 i;
+
+	ASSERT(offset < sizeof(this->regs) && !(offset & 3));
+	this->stats.writes++;
+
+	if (dw_model_irq_reg(offset, DW_MODEL_REG(MASK), &i)) {
+		this->mask[i] = dw_model_write_enable(this->mask[i], val) & DW_MODEL_CHAN_MASK;
+	}
+	else if (dw_model_irq_reg(offset, DW_MODEL_REG(CLEAR), &i)) {
+		this->raw[i] &= ~val;
+	}
+	else if (offset == DW_MODEL_REG(CH_EN)) {
+		UINT32 old = this->chEn;
+
+		this->chEn = dw_model_write_enable(this->chEn, val) & DW_MODEL_CHAN_MASK;
+		if (this->chEn & ~old)
+			run(this->chEn & ~old);
+	}
+	else if (offset >= DW_MODEL_REG(RAW) &&
+		offset < DW_MODEL_REG(MASK)) {
+		/* RAW and STATUS are read only */
+	}
+	else {
+		*(UINT32*)((UINT8*)&this->regs + offset) = val;
+	}
+}
+
+/*
+ * Run the newly enabled channels to completion one after the other; the
+ * per-channel beat counts tell how long they would have taken side by side.
+ * Finished channels drop out of CH_EN like on the hardware, failed ones
+ * stop at the offending block with SAR/DAR/CTL left pointing at it.
+ */
+void DwDMAModel::run(UINT32 start) {
+	this->stats.kicks++;
+
+	/* channels enabled on a disabled controller never start */
+	if (!(this->regs.CFG & DW_CFG_DMA_EN)) {
+		this->stats.errors++;
+		return;
+	}
+	if (this->hold)
+		return;
+	/* the DSP firmware's channels are not ours to start */
+	if (start & this->busy) {
+		this->stats.errors++;
+		return;
+	}
+
+	for (UINT32 ch = 0; ch < DW_DMA_MODEL_CHANNELS; ch++) {
+		if (!(start & (1 << ch)))
+			continue;
+
+		if (run_channel(ch)) {
+			this->raw[DW_MODEL_XFER] |= 1 << ch;
+		}
+		else {
+			this->raw[DW_MODEL_ERROR] |= 1 << ch;
+			this->stats.errors++;
+		}
+		this->chEn &= ~(1 << ch);
+	}
+
+	/* the LPE interrupt line */
+	if ((this->raw[DW_MODEL_XFER] & this->mask[DW_MODEL_XFER]) ||
+		(this->raw[DW_MODEL_ERROR] & this->mask[DW_MODEL_ERROR]))
+		this->dw->irq_handler();
+}
+
+/* Fetch and run LLIs until one without LLP_D_EN/LLP_S_EN, as multi-block mode does */
+BOOLEAN DwDMAModel::run_channel(UINT32 ch) {
+	struct dw_dma_chan_regs* regs = &this->regs.CHAN[ch];
+	UINT32 ctllo = regs->CTL_LO;
+	UINT32 n = 0;
+
+	/* DwDMA only starts channels on an LLP chain */
+	if (!(ctllo & (DWC_CTLL_LLP_D_EN | DWC_CTLL_LLP_S_EN)))
+		return FALSE;
+
+	while (ctllo & (DWC_CTLL_LLP_D_EN | DWC_CTLL_LLP_S_EN)) {
+		PHYSICAL_ADDRESS paddr;
+		const struct dw_lli* lli;
+
+		paddr.QuadPart = DWC_LLP_LOC(regs->LLP);
+		lli = paddr.QuadPart ? (const struct dw_lli*)MmGetVirtualForPhysical(paddr) : NULL;
+		if (!lli || ++n > DW_DMA_MODEL_MAX_LLIS)
+			return FALSE;
+
+		regs->SAR = lli->sar;
+		regs->DAR = lli->dar;
+		regs->CTL_LO = ctllo = lli->ctllo;
+		regs->CTL_HI = lli->ctlhi;
+		if (!run_block(ch, lli))
+			return FALSE;
+		regs->LLP = lli->llp;
+	}
+	return TRUE;
+}
+
+UINT8* DwDMAModel::arena_ptr(UINT32 addr, UINT32 len) {
+	if (!this->arena || addr - this->arenaAddr >= this->arenaSize ||
+		this->arenaSize - (addr - this->arenaAddr) < len)
+		return NULL;
+	return this->arena + (addr - this->arenaAddr);
+}
+
+BOOLEAN DwDMAModel::run_block(UINT32 ch, const struct dw_lli* lli) {
+	UINT32 width = (lli->ctllo >> 4) & 7;
+	UINT32 items = DWC_CTLH_BLOCK_TS(lli->ctlhi);
+	UINT32 smsize = (lli->ctllo >> 14) & 7;
+	UINT32 dmsize = (lli->ctllo >> 11) & 7;
+	UINT32 burst = smsize ? 1 << (smsize + 1) : 1;
+	UINT32 bytes = items << width;
+	UINT8* src;
+	UINT8* dst;
+
+	/* what the databook leaves undefined or the channel was not built for */
+	if (width != ((lli->ctllo >> 1) & 7) || (1u << width) > DW_DMA_MODEL_DATA_WIDTH ||
+		smsize != dmsize || burst > DW_DMA_MODEL_MAX_BURST ||
+		!items || items > DW_DMA_MODEL_BLOCK_TS ||
+		((lli->sar | lli->dar) & ((1 << width) - 1)))
+		return FALSE;
+
+	if (this->failAddr && this->failAddr - lli->dar < bytes)
+		return FALSE;
+
+	src = arena_ptr(lli->sar, bytes);
+	dst = arena_ptr(lli->dar, bytes);
+	if (src && dst)
+		RtlMoveMemory(dst, src, bytes);
+
+	this->stats.llis++;
+	this->stats.bytes += bytes;
+	this->stats.beats[ch] += items;
+	this->stats.bursts += items / burst + items % burst;
+	if (this->stats.nsegs < DW_DMA_MODEL_MAX_SEGS) {
+		struct dw_dma_model_seg* seg = &this->stats.segs[this->stats.nsegs++];
+
+		seg->ch = ch;
+		seg->src = lli->sar;
+		seg->dst = lli->dar;
+		seg->len = bytes;
+		seg->width = 1 << width;
+		seg->beats = items;
+	}
+
+	this->regs.CHAN[ch].SAR = lli->sar + bytes;
+	this->regs.CHAN[ch].DAR = lli->dar + bytes;
+	return TRUE;
+}
+
+/* every byte of the list moved exactly once, at the matching offset on both ends */
+static BOOLEAN dw_model_covers(DwDMAModel* model, const struct dw_dma_sg* sg, UINT32 count)
+{
+	UINT64 total = 0;
+
+	if (model->stats.nsegs != model->stats.llis)
+		return FALSE;
+
+	for (UINT32 s = 0; s < count; s++) {
+		UINT32 moved = 0;
+
+		for (UINT32 i = 0; i < model->stats.nsegs; i++) {
+			const struct dw_dma_model_seg* seg = &model->stats.segs[i];
+			UINT32 off = seg->dst - sg[s].dst;
+
+			if (off >= sg[s].len)
+				continue;
+			if (seg->src - sg[s].src != off || seg->len > sg[s].len - off)
+				return FALSE;
+			moved += seg->len;
+		}
+		if (moved != sg[s].len)
+			return FALSE;
+		total += sg[s].len;
+	}
+	return total == model->stats.bytes;
+}
+
+static UINT64 dw_model_busiest(DwDMAModel* model)
+{
+	UINT64 busiest = 0;
+
+	for (UINT32 ch = 0; ch < DW_DMA_MODEL_CHANNELS; ch++) {
+		if (model->stats.beats[ch] > busiest)
+			busiest = model->stats.beats[ch];
+	}
+	return busiest;
+}
+
+static UINT64 dw_model_beats(DwDMAModel* model)
+{
+	UINT64 beats = 0;
+
+	for (UINT32 ch = 0; ch < DW_DMA_MODEL_CHANNELS; ch++)
+		beats += model->stats.beats[ch];
+	return beats;
+}
+
+/*
+ * Beats spent on the head, body and tail of one copy against moving all of
+ * it at the single width the ends and length have in common.
+ */
+static void dw_model_report_split(DwDMAModel* model, const struct dw_dma_sg* sg)
+{
+	UINT32 len[3] = { 0, 0, 0 }, beats[3] = { 0, 0, 0 };
+	UINT32 widest = 0, part = 0, total;
+	UINT32 flat = 1 << __ffs(DW_DMA_MODEL_DATA_WIDTH | sg->src | sg->dst | sg->len);
+
+	for (UINT32 i = 0; i < model->stats.nsegs; i++) {
+		if (model->stats.segs[i].width > widest)
+			widest = model->stats.segs[i].width;
+	}
+	/* head, then body at the widest width, then tail */
+	for (UINT32 i = 0; i < model->stats.nsegs; i++) {
+		const struct dw_dma_model_seg* seg = &model->stats.segs[i];
+
+		if (seg->width == widest)
+			part = 1;
+		else if (part == 1)
+			part = 2;
+		len[part] += seg->len;
+		beats[part] += seg->beats;
+	}
+	total = beats[0] + beats[1] + beats[2];
+
+	ASSERT(beats[1] && total * flat < sg->len);
+	DPF(D_TERSE, ("DW DMA model: head %u B in %u beats, body %u B in %u beats, tail %u B in %u beats",
+		len[0], beats[0], len[1], beats[1], len[2], beats[2]));
+	DPF(D_TERSE, ("DW DMA model: %u.%02u bytes per beat in %llu transactions, one width: %u.00 bytes per beat in %u",
+		sg->len / total, (UINT32)((UINT64)sg->len * 100 / total % 100), model->stats.bursts,
+		flat, sg->len / flat));
+}
+
+#define DW_MODEL_ARENA_SIZE	(4 * PAGE_SIZE)
+#define DW_MODEL_LOAD_BLOCKS	32
+
+/*
+ * Drive a DwDMA instance against the model: copies land byte for byte,
+ * a failing block and a stuck channel come back as errors with the queue
+ * still usable, and the cost of the firmware load, channel split and
+ * head/body/tail paths is printed. Called at PASSIVE_LEVEL.
+ */
+void dw_dma_model_check(DmaPool* pool)
+{
+	struct dw_dma_sg sg[DW_MODEL_LOAD_BLOCKS];
+	struct dw_dma_stats dmaStats;
+	PHYSICAL_ADDRESS highest;
+	DwDMAModel* model;
+	DwDMA* dw;
+	UINT8* arena;
+	UINT64 beats, busiest;
+	UINT32 single, singleKicks;
+	NTSTATUS status;
+
+	model = new (NonPagedPool, DWDMA_MODEL_POOLTAG) DwDMAModel();
+	if (!model)
+		return;
+	dw = new (NonPagedPool, DWDMA_MODEL_POOLTAG) DwDMA(&model->regs, pool, NULL);
+	if (!dw) {
+		delete model;
+		return;
+	}
+	model->attach(dw);
+
+	status = dw->init();
+	ASSERT(NT_SUCCESS(status));
+	if (!NT_SUCCESS(status))
+		goto out;
+
+	/* real copies at both relative alignments, head/body and head/body/tail */
+	highest.QuadPart = 0xFFFFFFFF;
+	arena = (UINT8*)MmAllocateContiguousMemory(DW_MODEL_ARENA_SIZE, highest);
+	if (arena) {
+		UINT32 base = MmGetPhysicalAddress(arena).LowPart;
+
+		for (UINT32 i = 0; i < DW_MODEL_ARENA_SIZE / 2; i++)
+			arena[i] = (UINT8)(i * 7 + 1);
+		RtlZeroMemory(arena + DW_MODEL_ARENA_SIZE / 2, DW_MODEL_ARENA_SIZE / 2);
+
+		sg[0].dst = base + 0x2003;
+		sg[0].src = base + 0x1;
+		sg[0].len = 0x1001;
+		sg[1].dst = base + 0x3101;
+		sg[1].src = base + 0x1101;
+		sg[1].len = 0x7ff;
+
+		model->arena = arena;
+		model->arenaAddr = base;
+		model->arenaSize = DW_MODEL_ARENA_SIZE;
+		model->reset_stats();
+		status = dw->transfer_dma_sg(sg, 2);
+		model->arena = NULL;
+
+		ASSERT(NT_SUCCESS(status));
+		ASSERT(!model->stats.errors);
+		ASSERT(dw_model_covers(model, sg, 2));
+		for (UINT32 s = 0; s < 2; s++) {
+			UINT8* to = arena + (sg[s].dst - base);
+
+			ASSERT(RtlCompareMemory(to, arena + (sg[s].src - base), sg[s].len) == sg[s].len);
+			ASSERT(!to[-1] && !to[sg[s].len]);
+		}
+		MmFreeContiguousMemory(arena);
+	}
+
+	/* a failing block fails the copy */
+	sg[0].dst = 0x00080000;
+	sg[0].src = 0x10000000;
+	sg[0].len = 0x4000;
+	model->failAddr = sg[0].dst + 0x2000;
+	model->reset_stats();
+	status = dw->transfer_dma_sg(sg, 1);
+	model->failAddr = 0;
+	ASSERT(status == STATUS_DEVICE_DATA_ERROR);
+	ASSERT(!model->enabled_channels());
+
+	/* a stuck channel times out, is stopped, and the next copy still runs */
+	model->hold = TRUE;
+	status = dw->transfer_dma_sg(sg, 1);
+	model->hold = FALSE;
+	ASSERT(status == STATUS_IO_TIMEOUT);
+	ASSERT(!model->enabled_channels());
+
+	model->reset_stats();
+	status = dw->transfer_dma_sg(sg, 1);
+	ASSERT(NT_SUCCESS(status));
+	ASSERT(dw_model_covers(model, sg, 1));
+
+	dw->get_stats(&dmaStats);
+	ASSERT(dmaStats.failed == 2 && !dmaStats.queueDepth);
+
+	/*
+	 * The firmware load as one chain against one transfer per block. The
+	 * chain costs the same programming whatever the number of blocks.
+	 */
+	for (UINT32 i = 0; i < DW_MODEL_LOAD_BLOCKS; i++) {
+		sg[i].dst = 0x00080000 + i * 0x1000;
+		sg[i].src = 0x10000000 + i * 0x1100;
+		sg[i].len = 0x800;
+	}
+	model->reset_stats();
+	status = dw->transfer_dma_sg(sg, DW_MODEL_LOAD_BLOCKS / 4);
+	ASSERT(NT_SUCCESS(status));
+	single = model->stats.writes;
+
+	model->reset_stats();
+	status = dw->transfer_dma_sg(sg, DW_MODEL_LOAD_BLOCKS);
+	ASSERT(NT_SUCCESS(status));
+	ASSERT(dw_model_covers(model, sg, DW_MODEL_LOAD_BLOCKS));
+	ASSERT(model->stats.writes == single && model->stats.kicks == 1);
+	singleKicks = model->stats.kicks;
+
+	model->reset_stats();
+	for (UINT32 i = 0; i < DW_MODEL_LOAD_BLOCKS; i++) {
+		status = dw->transfer_dma(sg[i].dst, sg[i].src, sg[i].len);
+		ASSERT(NT_SUCCESS(status));
+	}
+	ASSERT(single < model->stats.writes);
+	DPF(D_TERSE, ("DW DMA model: %u blocks as one chain: %u register writes, %u starts; one transfer each: %u register writes, %u starts",
+		DW_MODEL_LOAD_BLOCKS, single, singleKicks, model->stats.writes, model->stats.kicks));
+
+	/* a copy large enough to be split over channels */
+	sg[0].dst = 0x00080000;
+	sg[0].src = 0x10000000;
+	sg[0].len = 0x80000;
+	model->reset_stats();
+	status = dw->transfer_dma_sg(sg, 1);
+	ASSERT(NT_SUCCESS(status));
+	ASSERT(dw_model_covers(model, sg, 1));
+	beats = dw_model_beats(model);
+	busiest = dw_model_busiest(model);
+	ASSERT(busiest && busiest * (DW_DMA_MAX_PARALLEL - 1) < beats);
+	DPF(D_TERSE, ("DW DMA model: 0x%x bytes in %llu beats, busiest channel %llu, x%llu.%02llu over one channel",
+		sg[0].len, beats, busiest, beats / busiest, beats * 100 / busiest % 100));
+
+	/* the same copy with two idle channels, the chains fold onto them */
+	model->busy = DW_MODEL_CHAN_MASK & ~3;
+	model->reset_stats();
+	status = dw->transfer_dma_sg(sg, 1);
+	model->busy = 0;
+	ASSERT(NT_SUCCESS(status));
+	ASSERT(!model->stats.errors);
+	ASSERT(dw_model_covers(model, sg, 1));
+	busiest = dw_model_busiest(model);
+	ASSERT(busiest * 2 == dw_model_beats(model));
+	DPF(D_TERSE, ("DW DMA model: two idle channels, busiest channel %llu, x%llu.%02llu over one channel",
+		busiest, beats / busiest, beats * 100 / busiest % 100));
+
+	/*
+	 * Odd addresses and length, the body still moves at the widest width
+	 * the relative alignment allows and at max burst: equally misaligned
+	 * ends, then ends two bytes apart.
+	 */
+	for (UINT32 i = 0; i < 2; i++) {
+		sg[0].dst = i ? 0x00080003 : 0x00080001;
+		sg[0].src = 0x10000001;
+		sg[0].len = 0x8001;
+		model->reset_stats();
+		status = dw->transfer_dma_sg(sg, 1);
+		ASSERT(NT_SUCCESS(status));
+		ASSERT(dw_model_covers(model, sg, 1));
+		dw_model_report_split(model, &sg[0]);
+	}
+
+out:
+	delete dw;
+	delete model;
+}
+#endif
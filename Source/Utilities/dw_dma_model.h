@@ -0,0 +1,81 @@
+#pragma once
+#include "dw_dma.h"
+
+#if DBG
+/*
+ * Register level model of the LPE's DesignWare AHB DMA controller. Once
+ * attached, DwDMA's readl/writel land here instead of the MMIO window.
+ * Setting a CH_EN bit walks that channel's LLP chain to the end on the spot:
+ * each block is checked against the limits advertised in DW_PARAMS and
+ * DWC_PARAMS, counted, copied when both ends fall inside the arena, and XFER
+ * or ERROR is raised through irq_handler() as the LPE interrupt would.
+ */
+#define DW_DMA_MODEL_CHANNELS	8
+#define DW_DMA_MODEL_MASTERS	2
+#define DW_DMA_MODEL_DATA_WIDTH	4	/* bytes, both masters */
+#define DW_DMA_MODEL_BLOCK_TS	4095	/* items per LLI */
+#define DW_DMA_MODEL_MAX_BURST	16	/* items per burst */
+#define DW_DMA_MODEL_MAX_SEGS	64
+/* more LLIs than a chain can span means the list loops */
+#define DW_DMA_MODEL_MAX_LLIS	(DW_DMA_MAX_PARALLEL * DW_DMA_MAX_LLI_PAGES * (DMA_POOL_BLOCK_SIZE / sizeof(struct dw_lli)))
+
+/* one LLI as the model ran it */
+struct dw_dma_model_seg {
+	UINT32 ch;
+	UINT32 src;
+	UINT32 dst;
+	UINT32 len;
+	UINT32 width;		/* bytes per beat */
+	UINT32 beats;
+};
+
+struct dw_dma_model_stats {
+	UINT32 reads;
+	UINT32 writes;		/* register programming operations */
+	UINT32 kicks;		/* CH_EN writes that started channels */
+	UINT32 llis;
+	UINT32 errors;		/* blocks refused or failed */
+	UINT64 bytes;
+	UINT64 beats[DW_DMA_MODEL_CHANNELS];	/* data beats per channel */
+	UINT64 bursts;		/* bus transactions, a partial burst goes as singles */
+	UINT32 nsegs;
+	struct dw_dma_model_seg segs[DW_DMA_MODEL_MAX_SEGS];
+};
+
+class DwDMAModel {
+public:
+	struct dw_dma_regs regs;
+
+	/* enabled channels never finish, for terminate() */
+	BOOLEAN hold;
+	/* channels CH_EN shows as running someone else's transfer */
+	UINT32 busy;
+	/* the block writing this address fails */
+	UINT32 failAddr;
+	/* host memory blocks really copy within, NULL to only count */
+	UINT8* arena;
+	UINT32 arenaAddr;
+	UINT32 arenaSize;
+
+	struct dw_dma_model_stats stats;
+
+	DwDMAModel();
+
+	void attach(DwDMA* dw);
+	void reset_stats();
+	UINT32 enabled_channels();
+
+	UINT32 readl(UINT32 offset);
+	void writel(UINT32 val, UINT32 offset);
+private:
+	DwDMA* dw;
+	UINT32 raw[5];
+	UINT32 mask[5];
+	UINT32 chEn;
+
+	void run(UINT32 start);
+	BOOLEAN run_channel(UINT32 ch);
+	BOOLEAN run_block(UINT32 ch, const struct dw_lli* lli);
+	UINT8* arena_ptr(UINT32 addr, UINT32 len);
+};
+#endif
@@ -16,6 +16,9 @@ Abstract:
 #include "hw.h"
 #include "resource.h"
 
+static_assert(DMA_POOL_BLOCKS >= eMaxDeviceType + 2 * DW_DMA_MAX_PARALLEL * DW_DMA_MAX_LLI_PAGES,
+    "DMA pool cannot hold every page table and the LLI pages of two copies");
+
 static NTSTATUS InterruptRoutine(PINTERRUPTSYNC InterruptSync,
     PVOID DynamicContext) {
     UNREFERENCED_PARAMETER(InterruptSync);
@@ -24,6 +27,13 @@ static NTSTATUS InterruptRoutine(PINTERRUPTSYNC InterruptSync,
 }
 
 #if USESSTHW
+static NTSTATUS DetachDmacRoutine(PINTERRUPTSYNC InterruptSync,
+    PVOID DynamicContext) {
+    UNREFERENCED_PARAMETER(InterruptSync);
+    CCsAudioCatptSSTHW* that = (CCsAudioCatptSSTHW*)DynamicContext;
+    return that->dsp_detach_dmac();
+}
+
 static struct catpt_spec wpt_desc = {
     .core_id = 0x02,
     .host_dram_offset = 0x000000,
@@ -46,7 +56,8 @@ static struct catpt_spec wpt_desc = {
 
 //=============================================================================
 #pragma code_seg("PAGE")
-CCsAudioCatptSSTHW::CCsAudioCatptSSTHW(_In_  PRESOURCELIST           ResourceList)
+CCsAudioCatptSSTHW::CCsAudioCatptSSTHW(_In_  PRESOURCELIST           ResourceList,
+                                       _In_  PDEVICE_OBJECT          DeviceObject)
 : m_ulMux(0),
     m_bDevSpecific(FALSE),
     m_iDevSpecific(0),
@@ -67,6 +78,10 @@ Return Value:
 {
     PAGED_CODE();
 
+    RtlZeroMemory(&m_BootTimes, sizeof(m_BootTimes));
+    RtlZeroMemory(&m_DxTimes, sizeof(m_DxTimes));
+    RtlZeroMemory(&m_ClockStats, sizeof(m_ClockStats));
+
 #if USESSTHW
     spec = &wpt_desc;
 
@@ -106,17 +121,51 @@ Return Value:
         return;
     }
 
+    this->dmapool = new (NonPagedPool, CSAUDIOCATPTSST_POOLTAG)DmaPool();
+    if (this->dmapool) {
+        NTSTATUS status = this->dmapool->init(DMA_POOL_BLOCKS, DMA_POOL_FW_SIZE, catpt_dram_size(this));
+        if (!NT_SUCCESS(status)) {
+            delete this->dmapool;
+            this->dmapool = NULL;
+            return;
+        }
+    }
+    else {
+        return;
+    }
+
     this->fw_ready = false;
+    this->dx_saved = false;
+    this->ssp1_ready = false;
     ExInitializeFastMutex(&clk_mutex);
 
+    KeInitializeTimer(&this->lpclock_timer);
+    KeInitializeDpc(&this->lpclock_dpc_obj, lpclock_dpc, this);
+    KeInitializeEvent(&this->lpclock_idle, NotificationEvent, TRUE);
+    this->lpclock_idle_ms = CATPT_LPCLOCK_IDLE_MS;
+    /* without it the clock drops to low-power right away */
+    this->lpclock_work = IoAllocateWorkItem(DeviceObject);
+
+#if DBG
+    this->ipc_capture = NULL;
+#endif
     ipc_init();
 
     sram_init(&this->dram, this->spec->host_dram_offset,
         catpt_dram_size(this));
     sram_init(&this->iram, this->spec->host_iram_offset,
         catpt_iram_size(this));
+
+#if DBG
+    catpt_check_chains();
+    catpt_check_page_table();
+    catpt_check_write_position();
+    catpt_check_deferred();
+    dw_dma_model_check(this->dmapool);
+#endif
 #else
     UNREFERENCED_PARAMETER(ResourceList);
+    UNREFERENCED_PARAMETER(DeviceObject);
 #endif
     
     MixerReset();
@@ -131,6 +180,8 @@ bool CCsAudioCatptSSTHW::ResourcesValidated() {
         return false;
     if (!this->m_InterruptSync)
         return false;
+    if (!this->dmapool)
+        return false;
     NTSTATUS status = this->m_InterruptSync->RegisterServiceRoutine(InterruptRoutine, (PVOID)this, FALSE);
     if (!NT_SUCCESS(status)) {
         return false;
@@ -145,13 +196,24 @@ bool CCsAudioCatptSSTHW::ResourcesValidated() {
 
 CCsAudioCatptSSTHW::~CCsAudioCatptSSTHW() {
 #if USESSTHW
+    KeRemoveQueueDpc(&this->fw_ready_dpc_obj);
+    KeFlushQueuedDpcs();
+
+    if (this->lpclock_work) {
+        dsp_flush_lpclock();
+        IoFreeWorkItem(this->lpclock_work);
+        this->lpclock_work = NULL;
+    }
+
     if (this->ipc_rx.data){
         ExFreePoolWithTag(this->ipc_rx.data, CSAUDIOCATPTSST_POOLTAG);
         this->ipc_rx.data = NULL;
     }
 
-    force_stop(&this->outStream);
-    force_stop(&this->inStream);
+    for (int i = 0; i < eMaxDeviceType; i++) {
+        force_stop(&this->streams[i]);
+        free_page_table(&this->streams[i]);
+    }
 
     if (this->m_InterruptSync) {
         this->m_InterruptSync->Disconnect();
@@ -159,6 +221,16 @@ CCsAudioCatptSSTHW::~CCsAudioCatptSSTHW() {
         this->m_InterruptSync = NULL;
     }
 
+    if (this->fw_manifest) {
+        ExFreePoolWithTag(this->fw_manifest, CSAUDIOCATPTSST_POOLTAG);
+        this->fw_manifest = NULL;
+    }
+
+    if (this->dmapool) {
+        delete this->dmapool;
+        this->dmapool = NULL;
+    }
+
     if (m_BAR0.Base.Base)
         MmUnmapIoSpace(m_BAR0.Base.Base, m_BAR0.Len);
     if (m_BAR1.Base.Base)
@@ -167,9 +239,24 @@ CCsAudioCatptSSTHW::~CCsAudioCatptSSTHW() {
 }
 
 #if USESSTHW
+/*
+ * A sleep lasts at least one timer tick, so waits this short spin instead.
+ * Polls spin in small steps for as long, since most conditions settle well
+ * within it, and only then fall back to the caller's interval.
+ */
+#define CATPT_SPIN_MAX_US   100
+#define CATPT_POLL_STEP_US  5
+
 void CCsAudioCatptSSTHW::udelay(ULONG usec) {
+    if (usec <= CATPT_SPIN_MAX_US) {
+        m_BootTimes.waits.spins++;
+        KeStallExecutionProcessor(usec);
+        return;
+    }
+
+    m_BootTimes.waits.sleeps++;
     LARGE_INTEGER Interval;
-    Interval.QuadPart = -10 * usec;
+    Interval.QuadPart = -10 * (LONGLONG)usec;
     KeDelayExecutionThread(KernelMode, false, &Interval);
 }
 
@@ -186,34 +273,71 @@ void CCsAudioCatptSSTHW::writel(UINT32 data, PVOID addr) {
 
 NTSTATUS CCsAudioCatptSSTHW::readl_poll_timeout(PVOID addr, UINT32 val, UINT32 mask, ULONG sleep_us, ULONG timeout_us) {
     UINT32 reg;
-    LARGE_INTEGER StartTime;
-    KeQuerySystemTimePrecise(&StartTime);
+    ULONGLONG start, elapsed;
+    ULONG64 qpc;
+
+    start = KeQueryInterruptTimePrecise(&qpc);
     for (;;) {
         reg = readl(addr);
-        LARGE_INTEGER CurrentTime;
-        KeQuerySystemTimePrecise(&CurrentTime);
-        if ((reg & mask) == val || ((CurrentTime.QuadPart - StartTime.QuadPart) / 10) > timeout_us)
-            break; \
-            if (sleep_us)\
-                udelay(sleep_us); \
-    }
-    return (reg & mask) == val ? STATUS_SUCCESS : STATUS_IO_TIMEOUT;
+        m_BootTimes.waits.polls++;
+        elapsed = (KeQueryInterruptTimePrecise(&qpc) - start) / 10;
+        if ((reg & mask) == val || elapsed > timeout_us)
+            break;
+        if (!sleep_us)
+            continue;
+        if (elapsed < CATPT_SPIN_MAX_US)
+            udelay(min(sleep_us, CATPT_POLL_STEP_US));
+        else
+            udelay(sleep_us);
+    }
+
+    if ((reg & mask) != val) {
+        m_BootTimes.waits.timeouts++;
+        return STATUS_IO_TIMEOUT;
+    }
+    return STATUS_SUCCESS;
 }
 #endif
 
 NTSTATUS CCsAudioCatptSSTHW::sst_init() {
 #if USESSTHW
+    ULONG64 qpc;
+
+    RtlZeroMemory(&m_BootTimes, sizeof(m_BootTimes));
+    m_BootTimes.start = KeQueryInterruptTimePrecise(&qpc);
+    m_BootTimes.restore = this->dx_saved;
+
     NTSTATUS status = dsp_power_up();
     if (!NT_SUCCESS(status)) {
         return status;
     }
+    boot_mark(CATPT_BOOT_POWER_UP);
+    this->lpclock_off = FALSE;
 
-    this->dmac = new (NonPagedPool, CSAUDIOCATPTSST_POOLTAG)DwDMA(this->lpe_ba + this->spec->host_dma_offset[CATPT_DMA_DEVID]);
+    this->dmac = new (NonPagedPool, CSAUDIOCATPTSST_POOLTAG)DwDMA(this->lpe_ba + this->spec->host_dma_offset[CATPT_DMA_DEVID], this->dmapool, this->m_InterruptSync);
     status = this->dmac->init();
     if (!NT_SUCCESS(status)) {
         return status;
     }
 
+    if (this->dx_saved) {
+        this->dx_saved = false;
+
+        status = sst_restore_context();
+        if (NT_SUCCESS(status)) {
+            return status;
+        }
+
+        DPF(D_ERROR, "DX context restore failed, cold booting\n");
+        m_BootTimes.restore = FALSE;
+        //cold boot from a fresh read of the file, not the copy that just failed
+        this->dmapool->fw_drop();
+        dsp_stall(true);
+        dsp_reset(true);
+        dsp_reset(false);
+        sst_release_sram();
+    }
+
     {
         status = catpt_boot_firmware(FALSE);
         if (!NT_SUCCESS(status)) {
@@ -244,6 +368,7 @@ NTSTATUS CCsAudioCatptSSTHW::sst_init() {
                 return status;
             }
         }
+        boot_mark(CATPT_BOOT_MIXER_INFO);
 
         status = catpt_arm_stream_templates();
         if (!NT_SUCCESS(status)) {
@@ -254,20 +379,11 @@ NTSTATUS CCsAudioCatptSSTHW::sst_init() {
         /* update dram pg for scratch and restricted regions */
         dsp_update_srampge(&this->dram, this->spec->dram_mask);
 
-        {
-            //Set device fmt
-            struct catpt_ssp_device_format devfmt;
-            devfmt.channels = 2;
-            devfmt.iface = CATPT_SSP_IFACE_0;
-            devfmt.mclk = CATPT_MCLK_FREQ_24_MHZ;
-            devfmt.mode = CATPT_SSP_MODE_I2S_PROVIDER;
-            devfmt.clock_divider = 9;
-            status = ipc_set_device_format(&devfmt);
-            if (!NT_SUCCESS(status)) {
-                DPF(D_ERROR, "set device fmt failed\n");
-                return status;
-            }
+        status = sst_set_device_formats();
+        if (!NT_SUCCESS(status)) {
+            return status;
         }
+        boot_mark(CATPT_BOOT_DEVICE_FORMAT);
 
         {
             //Set mixer volume
@@ -281,18 +397,15 @@ NTSTATUS CCsAudioCatptSSTHW::sst_init() {
 
         {
             //Check if streams need to be resumed
-            if (this->outStream.allocated) {
-                this->outStream.allocated = false;
-                CatPtPrint(DEBUG_LEVEL_VERBOSE, DBG_PNP, "Reprogramming stream %d\n", eSpeakerDevice);
-                sst_program_dma(eSpeakerDevice, this->outStream.byteCount, this->outStream.pMDL, this->outStream.waveRtStream);
-                sst_play(eSpeakerDevice);
-            }
-
-            if (this->inStream.allocated) {
-                this->inStream.allocated = false;
-                CatPtPrint(DEBUG_LEVEL_VERBOSE, DBG_PNP, "Reprogramming stream %d\n", eMicJackDevice);
-                sst_program_dma(eMicJackDevice, this->inStream.byteCount, this->inStream.pMDL, this->inStream.waveRtStream);
-                sst_play(eMicJackDevice);
+            for (int deviceType = eSpeakerDevice; deviceType < eMaxDeviceType; deviceType++) {
+                catpt_stream* stream = catpt_stream_get((eDeviceType)deviceType);
+                if (!stream->allocated)
+                    continue;
+
+                stream->allocated = false;
+                CatPtPrint(DEBUG_LEVEL_VERBOSE, DBG_PNP, "Reprogramming stream %d\n", deviceType);
+                sst_program_dma((eDeviceType)deviceType, stream->byteCount, stream->pMDL, stream->waveRtStream, &stream->format);
+                sst_play((eDeviceType)deviceType);
             }
         }
     }
@@ -305,23 +418,227 @@ NTSTATUS CCsAudioCatptSSTHW::sst_init() {
 #endif
 }
 
-NTSTATUS CCsAudioCatptSSTHW::sst_deinit() {
 #if USESSTHW
-    if (this->dmac) {
-        delete this->dmac;
-        this->dmac = NULL;
+NTSTATUS CCsAudioCatptSSTHW::sst_set_device_formats() {
+    NTSTATUS status;
+
+    {
+        //Set device fmt
+        struct catpt_ssp_device_format devfmt;
+        devfmt.channels = 2;
+        devfmt.iface = CATPT_SSP_IFACE_0;
+        devfmt.mclk = CATPT_MCLK_FREQ_24_MHZ;
+        devfmt.mode = CATPT_SSP_MODE_I2S_PROVIDER;
+        devfmt.clock_divider = 9;
+        status = ipc_set_device_format(&devfmt);
+        if (!NT_SUCCESS(status)) {
+            DPF(D_ERROR, "set device fmt failed\n");
+            return status;
+        }
     }
 
-    NTSTATUS status = dsp_power_down();
+    {
+        //SSP1 is wired to the BT module, which provides the clocks.
+        //Without it only the Bluetooth endpoints are lost, so carry on.
+        struct catpt_ssp_device_format devfmt;
+        devfmt.channels = 1;
+        devfmt.iface = CATPT_SSP_IFACE_1;
+        devfmt.mclk = CATPT_MCLK_OFF;
+        devfmt.mode = CATPT_SSP_MODE_I2S_CONSUMER;
+        devfmt.clock_divider = 0;
+        this->ssp1_ready = NT_SUCCESS(ipc_set_device_format(&devfmt));
+        if (!this->ssp1_ready) {
+            DPF(D_ERROR, "set bt device fmt failed, Bluetooth endpoints disabled\n");
+        }
+    }
+
+    return status;
+}
+
+/*
+ * Park the firmware in D3 and copy out what it needs to come back. Live
+ * streams are paused first, the firmware then reports which DRAM ranges
+ * matter and those go to the DX buffer together with module and stream
+ * state.
+ */
+NTSTATUS CCsAudioCatptSSTHW::sst_save_context() {
+    PHYSICAL_ADDRESS dxAddr;
+    NTSTATUS status;
+
+    if (!this->dmac || !this->fw_ready || !this->dmapool->dx_region(&dxAddr)) {
+        return STATUS_DEVICE_NOT_READY;
+    }
+
+    for (int deviceType = eSpeakerDevice; deviceType < eMaxDeviceType; deviceType++) {
+        catpt_stream* stream = catpt_stream_get((eDeviceType)deviceType);
+        if (!stream->allocated || !stream->prepared)
+            continue;
+
+        status = ipc_pause_stream((UINT8)stream->info.stream_hw_id);
+        if (!NT_SUCCESS(status)) {
+            return status;
+        }
+    }
+    dx_mark(CATPT_DX_STREAMS_PAUSED);
+
+    RtlZeroMemory(&this->dx_ctx, sizeof(this->dx_ctx));
+    status = ipc_enter_dxstate(CATPT_DX_STATE_D3, &this->dx_ctx);
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+    if (this->dx_ctx.num_meminfo > SAVE_MEMINFO_MAX) {
+        return STATUS_INVALID_DEVICE_STATE;
+    }
+    dx_mark(CATPT_DX_ENTER_D3);
+
+    status = dsp_stall(true);
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+    dx_mark(CATPT_DX_STALL);
+
+    status = catpt_store_context(dxAddr);
+    if (!NT_SUCCESS(status)) {
+        DPF(D_ERROR, "DX context save failed: 0x%x\n", status);
+        return status;
+    }
+    dx_mark(CATPT_DX_CONTEXT_STORED);
+    return status;
+}
+
+/*
+ * Bring the firmware back from the saved context. The SRAM layout, module
+ * table, mixer info and stream allocations all survived, only the SSP
+ * setup has to be redone before the paused streams are resumed.
+ */
+NTSTATUS CCsAudioCatptSSTHW::sst_restore_context() {
+    NTSTATUS status;
+
+    status = catpt_boot_firmware(TRUE);
     if (!NT_SUCCESS(status)) {
         return status;
     }
 
-    this->outStream.persistent = NULL;
-    this->inStream.persistent = NULL;
+    status = sst_set_device_formats();
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+    boot_mark(CATPT_BOOT_DEVICE_FORMAT);
+
+    for (int deviceType = eSpeakerDevice; deviceType < eMaxDeviceType; deviceType++) {
+        catpt_stream* stream = catpt_stream_get((eDeviceType)deviceType);
+        if (!stream->allocated || !stream->prepared)
+            continue;
+        //left paused, SSP1 refused its format this time
+        if (!this->ssp1_ready &&
+            (deviceType == eBthHfpSpeakerDevice || deviceType == eBthHfpMicDevice))
+            continue;
+
+        CatPtPrint(DEBUG_LEVEL_VERBOSE, DBG_PNP, "Resuming stream %d\n", deviceType);
+        status = ipc_resume_stream((UINT8)stream->info.stream_hw_id);
+        if (!NT_SUCCESS(status)) {
+            return status;
+        }
+    }
+
+    return dsp_update_lpclock();
+}
+
+void CCsAudioCatptSSTHW::boot_mark(enum catpt_boot_phase phase) {
+    ULONG64 qpc;
+
+    m_BootTimes.phase[phase] = KeQueryInterruptTimePrecise(&qpc) - m_BootTimes.start;
+}
+
+void CCsAudioCatptSSTHW::dx_mark(enum catpt_dx_phase phase) {
+    ULONG64 qpc;
+
+    m_DxTimes.phase[phase] = KeQueryInterruptTimePrecise(&qpc) - m_DxTimes.start;
+}
+
+void CCsAudioCatptSSTHW::sst_release_sram() {
+    for (int i = 0; i < eMaxDeviceType; i++) {
+        this->streams[i].persistent = NULL;
+    }
 
     sram_free(&this->iram);
     sram_free(&this->dram);
+}
+#endif
+
+BOOL CCsAudioCatptSSTHW::sst_idle() {
+#if USESSTHW
+    return !dsp_clock_busy();
+#else
+    return TRUE;
+#endif
+}
+
+const struct catpt_boot_times* CCsAudioCatptSSTHW::sst_boot_times() {
+    return &m_BootTimes;
+}
+
+const struct catpt_dx_times* CCsAudioCatptSSTHW::sst_dx_times() {
+    return &m_DxTimes;
+}
+
+const struct catpt_clock_stats* CCsAudioCatptSSTHW::sst_clock_stats() {
+    return &m_ClockStats;
+}
+
+void CCsAudioCatptSSTHW::sst_set_lpclock_idle(ULONG ms) {
+#if USESSTHW
+    this->lpclock_idle_ms = ms;
+#else
+    UNREFERENCED_PARAMETER(ms);
+#endif
+}
+
+NTSTATUS CCsAudioCatptSSTHW::sst_deinit() {
+#if USESSTHW
+    struct catpt_wait_stats waits = m_BootTimes.waits;
+    ULONG64 qpc;
+
+    RtlZeroMemory(&m_DxTimes, sizeof(m_DxTimes));
+    m_DxTimes.start = KeQueryInterruptTimePrecise(&qpc);
+
+    /*
+     * No clock switch may run from here on: not in the middle of the
+     * ENTER_DX exchange and the context DMA, and not against the powered
+     * down DSP afterwards.
+     */
+    dsp_flush_lpclock();
+    dx_mark(CATPT_DX_CLOCK_FLUSHED);
+
+    /* SRAM and streams stay as they are if the context made it out */
+    this->dx_saved = NT_SUCCESS(sst_save_context());
+    m_DxTimes.saved = this->dx_saved;
+
+    if (this->dmac) {
+        //Mask and unpublish under the interrupt lock, the ISR looks at dmac
+        DwDMA* dmac = this->dmac;
+        if (this->m_InterruptSync) {
+            this->m_InterruptSync->CallSynchronizedRoutine(DetachDmacRoutine, this);
+        } else {
+            this->dmac = NULL;
+        }
+        delete dmac;
+    }
+
+    NTSTATUS status = dsp_power_down();
+
+    m_DxTimes.waits.spins = m_BootTimes.waits.spins - waits.spins;
+    m_DxTimes.waits.sleeps = m_BootTimes.waits.sleeps - waits.sleeps;
+    m_DxTimes.waits.polls = m_BootTimes.waits.polls - waits.polls;
+    m_DxTimes.waits.timeouts = m_BootTimes.waits.timeouts - waits.timeouts;
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+    dx_mark(CATPT_DX_POWER_DOWN);
+
+    if (!this->dx_saved) {
+        sst_release_sram();
+    }
     return status;
 #else
     return STATUS_SUCCESS;
@@ -337,14 +654,8 @@ NTSTATUS CCsAudioCatptSSTHW::sst_play(eDeviceType deviceType) {
 
     catpt_stream* stream;
 
-    switch (deviceType) {
-    case eSpeakerDevice:
-        stream = &this->outStream;
-        break;
-    case eMicJackDevice:
-        stream = &this->inStream;
-        break;
-    default:
+    stream = catpt_stream_get(deviceType);
+    if (!stream) {
         DPF(D_ERROR, "Unknown device type");
         return STATUS_INVALID_PARAMETER;
     }
@@ -383,14 +694,8 @@ NTSTATUS CCsAudioCatptSSTHW::sst_stop(eDeviceType deviceType) {
 
     CatPtPrint(DEBUG_LEVEL_VERBOSE, DBG_IOCTL, "Stopping stream %d\n", deviceType);
 
-    switch (deviceType) {
-    case eSpeakerDevice:
-        stream = &this->outStream;
-        break;
-    case eMicJackDevice:
-        stream = &this->inStream;
-        break;
-    default:
+    stream = catpt_stream_get(deviceType);
+    if (!stream) {
         DPF(D_ERROR, "Unknown device type");
         return STATUS_INVALID_PARAMETER;
     }
@@ -410,7 +715,6 @@ NTSTATUS CCsAudioCatptSSTHW::sst_stop(eDeviceType deviceType) {
     }
 
     stream->prepared = false;
-    dsp_update_lpclock();
 
     status = ipc_free_stream(stream_id);
     if (!NT_SUCCESS(status)) {
@@ -418,6 +722,7 @@ NTSTATUS CCsAudioCatptSSTHW::sst_stop(eDeviceType deviceType) {
     }
 
     force_stop(stream);
+    dsp_update_lpclock();
     return status;
     
 #else
@@ -427,10 +732,6 @@ NTSTATUS CCsAudioCatptSSTHW::sst_stop(eDeviceType deviceType) {
 }
 
 void CCsAudioCatptSSTHW::force_stop(catpt_stream* stream) {
-    if (stream->pageTable) {
-        MmFreeContiguousMemory(stream->pageTable);
-        stream->pageTable = NULL;
-    }
     stream->allocated = false;
 
     if (stream->persistent) {
@@ -443,19 +744,35 @@ void CCsAudioCatptSSTHW::force_stop(catpt_stream* stream) {
     dsp_update_srampge(&this->dram, this->spec->dram_mask);
 }
 
+void CCsAudioCatptSSTHW::free_page_table(catpt_stream* stream) {
+    if (stream->pageTable) {
+        this->dmapool->free_block(stream->pageTable);
+        stream->pageTable = NULL;
+    }
+    stream->pageTableMdl = NULL;
+    stream->pageTableCount = 0;
+}
+
+void CCsAudioCatptSSTHW::sst_release_buffer(PMDL mdl) {
+#if USESSTHW
+    //The MDL is about to be freed, a new one may reuse its address
+    for (int i = 0; i < eMaxDeviceType; i++) {
+        catpt_stream* stream = &this->streams[i];
+        if (stream->pageTableMdl == mdl && !stream->allocated)
+            free_page_table(stream);
+    }
+#else
+    UNREFERENCED_PARAMETER(mdl);
+#endif
+}
+
 NTSTATUS CCsAudioCatptSSTHW::sst_current_position(eDeviceType deviceType, UINT32 *linkPos, UINT64 *linearPos) {
 #if USESSTHW
     UINT32 regaddr;
     catpt_stream* stream;
 
-    switch (deviceType) {
-    case eSpeakerDevice:
-        stream = &this->outStream;
-        break;
-    case eMicJackDevice:
-        stream = &this->inStream;
-        break;
-    default:
+    stream = catpt_stream_get(deviceType);
+    if (!stream) {
         DPF(D_ERROR, "Unknown device type");
         return STATUS_INVALID_PARAMETER;
     }
@@ -464,6 +781,8 @@ NTSTATUS CCsAudioCatptSSTHW::sst_current_position(eDeviceType deviceType, UINT32
         return STATUS_INVALID_PARAMETER;
     }
 
+    stream_sync_buffer(stream);
+
     regaddr = stream->info.read_pos_regaddr;
 
     UINT32 pos;
@@ -481,6 +800,33 @@ NTSTATUS CCsAudioCatptSSTHW::sst_current_position(eDeviceType deviceType, UINT32
     return STATUS_SUCCESS;
 }
 
+NTSTATUS CCsAudioCatptSSTHW::sst_set_write_position(eDeviceType deviceType, UINT32 writePos) {
+#if USESSTHW
+    catpt_stream* stream;
+
+    stream = catpt_stream_get(deviceType);
+    if (!stream) {
+        DPF(D_ERROR, "Unknown device type");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (!stream->allocated) {
+        return STATUS_INVALID_DEVICE_STATE;
+    }
+
+    //only offload streams consume a client-driven write pointer
+    if (stream->templ->type != CATPT_STRM_TYPE_RENDER) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    return ipc_set_write_pos((UINT8)stream->info.stream_hw_id, writePos, false, false);
+#else
+    UNREFERENCED_PARAMETER(deviceType);
+    UNREFERENCED_PARAMETER(writePos);
+    return STATUS_SUCCESS;
+#endif
+}
+
 //=============================================================================
 BOOL
 CCsAudioCatptSSTHW::bGetDevSpecific()
@@ -80,6 +80,7 @@ enum PCI_POWER {
 #include "firmware.h"
 #include "registers.h"
 #include "dw_dma.h"
+#include "dmapool.h"
 
 /*
 * Either engine 0 or 1 can be used for image loading.
@@ -87,6 +88,8 @@ enum PCI_POWER {
 */
 #define CATPT_DMA_DEVID		1
 #define CATPT_DMA_DSP_ADDR_MASK	GENMASK(31, 20)
+/* DX save: memory dumps, module state windows and stream persistent areas */
+#define CATPT_DMA_SG_MAX	(SAVE_MEMINFO_MAX + CATPT_MODULE_COUNT + eMaxDeviceType)
 
 #define CATPT_IPC_TIMEOUT_MS	300
 
@@ -99,6 +102,16 @@ struct catpt_ipc_msg {
     size_t size;
 };
 
+#if DBG
+//while set, ipc_send_msg() records requests here instead of sending them
+struct catpt_ipc_capture {
+    UINT32 count;
+    UINT32 header;
+    size_t size;
+    UINT8 data[16];
+};
+#endif
+
 struct catpt_module_type {
     bool loaded;
     UINT32 entry_point;
@@ -107,6 +120,27 @@ struct catpt_module_type {
     /* DRAM, initial module state */
     UINT32 state_offset;
     UINT32 state_size;
+    /* module header within the resident image, 0 if not in the image */
+    UINT32 image_offset;
+};
+
+/* one firmware block: where it sits in the image and in SRAM */
+struct catpt_fw_window {
+    struct dw_dma_sg sg;
+    UINT16 module_id;
+    BOOLEAN iram;
+    BOOLEAN instance;       /* DRAM block with the module's initial state */
+    BOOLEAN deferred;
+};
+
+/* everything catpt_load_firmware() needs from a parsed image */
+struct catpt_fw_manifest {
+    struct catpt_module_type modules[CATPT_MODULE_COUNT];
+    /* resident image the windows point into, its headers checked before every boot */
+    UINT32 image_size;
+    UINT32 image_hash;
+    UINT32 count;
+    struct catpt_fw_window windows[ANYSIZE_ARRAY];
 };
 
 struct catpt_spec {
@@ -124,16 +158,36 @@ struct catpt_spec {
     UINT32 pll_shutdown_val;
 };
 
+#define CATPT_STREAM_MAX_MODULES 4
+
+/* ring page table is a single page of packed 20-bit PFNs */
+#define CATPT_PAGE_TABLE_MAX_PAGES ((PAGE_SIZE * 8) / 20)
+
 struct catpt_stream {
     struct catpt_stream_template* templ;
     struct catpt_stream_info info;
     PRESOURCE persistent;
 
+    /* module chain built from templ for the current format */
+    UINT8 num_entries;
+    struct catpt_module_entry entries[CATPT_STREAM_MAX_MODULES];
+    UINT32 persistent_size;
+
+    /* packed page table, kept as long as the ring's MDL stays the same */
     PVOID pageTable;
+    PMDL pageTableMdl;
+    UINT32 pageTableCount;
+    PHYSICAL_ADDRESS pageTableAddr;
+    UINT32 firstPagePfn;
 
     UINT32 byteCount;
     PMDL pMDL;
     IPortWaveRTStream* waveRtStream;
+    WAVEFORMATEXTENSIBLE format;
+
+    /* set on a DSP position notification, cleared once the ring is synced */
+    LONG syncPending;
+    UINT32 notifyPos;
 
     BOOL allocated;
     BOOL prepared;
@@ -146,6 +200,87 @@ struct catpt_stream {
 // BUGBUG we should dynamically allocate this...
 #define MAX_TOPOLOGY_NODES      20
 
+//
+// Boot phases timed by sst_init, reported through ETW as
+// eMINIPORT_IHV_DEFINED events: CATPT_ETW_BOOT_PHASE, phase,
+// microseconds since sst_init started, restore.
+//
+#define CATPT_ETW_BOOT_PHASE    0x43415054  // 'CAPT'
+//
+// Followed by one CATPT_ETW_BOOT_WAITS event: spins, sleeps, polls.
+//
+#define CATPT_ETW_BOOT_WAITS    0x43415057  // 'CAPW'
+//
+// And one CATPT_ETW_CLOCK event: switches, held, microseconds spent
+// switching, all since the driver loaded.
+//
+#define CATPT_ETW_CLOCK         0x43415043  // 'CAPC'
+
+//
+// D3 phases timed by sst_deinit, one CATPT_ETW_DX_PHASE event each:
+// phase, microseconds since sst_deinit started, context saved. Then
+// one CATPT_ETW_DX_WAITS event: spins, sleeps, polls during sst_deinit.
+//
+#define CATPT_ETW_DX_PHASE      0x43415044  // 'CAPD'
+#define CATPT_ETW_DX_WAITS      0x43415058  // 'CAPX'
+
+/* default hold-off before dropping to the low-power clock */
+#define CATPT_LPCLOCK_IDLE_MS   2000
+/* default time without streams before the DSP is put in D3 at runtime */
+#define CATPT_DSP_IDLE_MS       10000
+
+enum catpt_boot_phase {
+    CATPT_BOOT_POWER_UP,
+    CATPT_BOOT_DMA_LOAD,
+    CATPT_BOOT_STALL_RELEASE,
+    CATPT_BOOT_FW_READY,
+    CATPT_BOOT_MIXER_INFO,
+    CATPT_BOOT_DEVICE_FORMAT,
+    CATPT_BOOT_PHASE_COUNT
+};
+
+enum catpt_dx_phase {
+    CATPT_DX_CLOCK_FLUSHED,
+    CATPT_DX_STREAMS_PAUSED,
+    CATPT_DX_ENTER_D3,
+    CATPT_DX_STALL,
+    CATPT_DX_CONTEXT_STORED,
+    CATPT_DX_POWER_DOWN,
+    CATPT_DX_PHASE_COUNT
+};
+
+/* udelay/readl_poll_timeout activity since sst_init started */
+struct catpt_wait_stats {
+    ULONG spins;
+    ULONG sleeps;
+    ULONG polls;
+    ULONG timeouts;
+};
+
+struct catpt_clock_stats {
+    ULONG switches;
+    /* low-power switches called off by a stream within the hold-off */
+    ULONG held;
+    /* 100ns units spent in switches, WAITI and CLKCTL polls included */
+    ULONGLONG waitTime;
+};
+
+struct catpt_boot_times {
+    ULONGLONG start;
+    /* 100ns units after start, 0 if the phase was not reached */
+    ULONGLONG phase[CATPT_BOOT_PHASE_COUNT];
+    BOOL restore;
+    struct catpt_wait_stats waits;
+};
+
+struct catpt_dx_times {
+    ULONGLONG start;
+    /* 100ns units after start, 0 if the phase was not reached */
+    ULONGLONG phase[CATPT_DX_PHASE_COUNT];
+    BOOL saved;
+    struct catpt_wait_stats waits;
+};
+
 //=============================================================================
 // Classes
 //=============================================================================
@@ -163,6 +298,9 @@ protected:
     BOOL                        m_bDevSpecific;
     INT                         m_iDevSpecific;
     UINT                        m_uiDevSpecific;
+    struct catpt_boot_times     m_BootTimes;        // last sst_init
+    struct catpt_dx_times       m_DxTimes;          // last sst_deinit
+    struct catpt_clock_stats    m_ClockStats;       // since load
 #if USESSTHW
     PCI_BAR m_BAR0;
     PCI_BAR m_BAR1;
@@ -174,6 +312,7 @@ protected:
     PRESOURCE scratch;
 
     DwDMA* dmac;
+    DmaPool* dmapool;
 #endif
 
 #if USEACPHW
@@ -189,23 +328,38 @@ private:
 
     struct catpt_mixer_stream_info mixer;
 
-    catpt_stream outStream;
-    catpt_stream inStream;
+    /* one DSP stream per device type, see catpt_stream_get */
+    catpt_stream streams[eMaxDeviceType];
     FAST_MUTEX clk_mutex;
 
+    //low-power clock hold-off, see dsp_update_lpclock
+    KTIMER lpclock_timer;
+    KDPC lpclock_dpc_obj;
+    PIO_WORKITEM lpclock_work;
+    KEVENT lpclock_idle;
+    LONG lpclock_queued;
+    ULONG lpclock_idle_ms;
+    BOOL lpclock_off;       //set by dsp_flush_lpclock, cleared on power up
+    static KDEFERRED_ROUTINE lpclock_dpc;
+    static IO_WORKITEM_ROUTINE lpclock_worker;
+
     void udelay(ULONG usec);
     UINT32 readl(PVOID reg);
     void writel(UINT32 val, PVOID reg);
     NTSTATUS readl_poll_timeout(PVOID reg, UINT32 val, UINT32 mask, ULONG sleep_us, ULONG timeout_us);
 
     //DSP Private methods
+    NTSTATUS dsp_switch_lpclock(BOOL lp, BOOL waiti);
     NTSTATUS dsp_select_lpclock(BOOL lp, BOOL waiti);
+    BOOL dsp_clock_busy();
     NTSTATUS dsp_update_lpclock();
+    void dsp_flush_lpclock();
     void dsp_set_regs_defaults();
     void dsp_set_srampge(PRESOURCE sram, unsigned long mask, unsigned long newVal);
     void dsp_update_srampge(PRESOURCE sram, unsigned long mask);
     NTSTATUS dsp_stall(BOOL stall);
     NTSTATUS dsp_reset(BOOL reset);
+    NTSTATUS dsp_dma_sg_fromdsp(const struct dw_dma_sg* sg, UINT32 count);
 
     //DSP methods
     NTSTATUS dsp_power_down();
@@ -213,23 +367,56 @@ private:
 
     //loader vars
     struct catpt_module_type modules[CATPT_MODULE_COUNT];
+    struct catpt_fw_manifest* fw_manifest;
     BOOL fw_ready;
+    NTSTATUS fw_ready_status;
+
+    //FW_READY is picked up in the ISR and armed from fw_ready_dpc
+    KEVENT fw_ready_event;
+    KDPC fw_ready_dpc_obj;
+    struct catpt_fw_ready fw_ready_config;
+    static KDEFERRED_ROUTINE fw_ready_dpc;
+
+    //D3 context, valid while dx_saved is set
+    struct catpt_dx_context dx_ctx;
+    BOOL dx_saved;
+
+    //SSP1 took its device format, the Bluetooth endpoints can stream
+    BOOL ssp1_ready;
 
     //loader private methods
     void sram_init(PRESOURCE sram, UINT32 start, UINT32 size);
     void sram_free(PRESOURCE sram);
     PRESOURCE catpt_request_region(PRESOURCE root, size_t size);
 
-    NTSTATUS catpt_load_block(PHYSICAL_ADDRESS pAddr, struct catpt_fw_block_hdr* blk, bool alloc);
-    NTSTATUS catpt_load_module(PHYSICAL_ADDRESS paddr, struct catpt_fw_mod_hdr* mod);
-    NTSTATUS catpt_load_firmware(PHYSICAL_ADDRESS paddr, struct catpt_fw_hdr* fw);
+    void catpt_load_block(PHYSICAL_ADDRESS pAddr, struct catpt_fw_block_hdr* blk, struct dw_dma_sg* sg);
+    NTSTATUS catpt_index_module(PHYSICAL_ADDRESS paddr, UINT32 image_offset,
+        struct catpt_fw_mod_hdr* mod, bool defer, struct catpt_fw_manifest* man);
+    NTSTATUS catpt_index_image(PHYSICAL_ADDRESS paddr, struct catpt_fw_hdr* fw, SIZE_T size);
+    UINT32 catpt_dx_windows(struct dw_dma_sg* sg, PHYSICAL_ADDRESS dxAddr, BOOL toDsp);
+    NTSTATUS catpt_store_context(PHYSICAL_ADDRESS dxAddr);
+    UINT32 catpt_restore_window(struct catpt_fw_window* win,
+        PHYSICAL_ADDRESS dxAddr, struct dw_dma_sg* sg);
+    NTSTATUS catpt_load_firmware(BOOL restore);
     NTSTATUS catpt_load_image(PCWSTR path, BOOL restore);
+    NTSTATUS catpt_load_deferred(UINT16 module_id);
 
     //loader methods
     NTSTATUS catpt_boot_firmware(BOOL restore);
 
+    //power private methods
+    void boot_mark(enum catpt_boot_phase phase);
+    void dx_mark(enum catpt_dx_phase phase);
+    NTSTATUS sst_set_device_formats();
+    NTSTATUS sst_save_context();
+    NTSTATUS sst_restore_context();
+    void sst_release_sram();
+
     //IPC vars
     struct catpt_ipc_msg ipc_rx;
+#if DBG
+    struct catpt_ipc_capture* ipc_capture;
+#endif
     struct catpt_fw_ready ipc_config;
     BOOL ipc_ready;
 
@@ -250,15 +437,27 @@ private:
 
     //PCM private methods
     NTSTATUS catpt_arm_stream_templates();
+    bool catpt_module_eager(UINT16 module_id);
     struct catpt_stream* catpt_stream_find(UINT8 stream_hw_id);
+    struct catpt_stream* catpt_stream_get(eDeviceType deviceType);
+    NTSTATUS catpt_stream_compose(struct catpt_stream* stream);
+#if DBG
+    void catpt_check_chains();
+    void catpt_check_page_table();
+    void catpt_check_write_position();
+    void catpt_check_deferred();
+#endif
     NTSTATUS set_dsp_vol(UINT8 stream_id, LONG* ctlvol);
     void stream_update_position(struct catpt_stream* stream, struct catpt_notify_position* pos);
+    void stream_sync_buffer(struct catpt_stream* stream);
 
     //messages private methods
     NTSTATUS ipc_alloc_stream(enum catpt_path_id path_id, enum catpt_stream_type type,
-        struct catpt_audio_format* afmt, struct catpt_ring_info* rinfo, UINT8 num_modules,
+        enum catpt_format_id format_id, struct catpt_audio_format* afmt, struct catpt_ring_info* rinfo, UINT8 num_modules,
         struct catpt_module_entry* modules, PRESOURCE persistent, struct catpt_stream_info* sinfo);
     NTSTATUS ipc_free_stream(UINT8 stream_hw_id);
+    NTSTATUS ipc_enter_dxstate(enum catpt_dx_state state,
+        struct catpt_dx_context* context);
     NTSTATUS ipc_set_device_format(struct catpt_ssp_device_format* devfmt);
     NTSTATUS ipc_set_volume(UINT8 stream_hw_id,
         UINT32 channel, UINT32 volume,
@@ -271,21 +470,32 @@ private:
     NTSTATUS ipc_resume_stream(UINT8 stream_hw_id);
 public:
     NTSTATUS dsp_irq_handler();
+    NTSTATUS dsp_detach_dmac();
 #endif
 
 public:
-    CCsAudioCatptSSTHW(_In_  PRESOURCELIST           ResourceList);
+    CCsAudioCatptSSTHW(_In_  PRESOURCELIST           ResourceList,
+                       _In_  PDEVICE_OBJECT          DeviceObject);
     ~CCsAudioCatptSSTHW();
 
     bool                        ResourcesValidated();
     NTSTATUS sst_init();
     NTSTATUS sst_deinit();
+    BOOL sst_idle();
+    BOOL sst_format_supported(eDeviceType deviceType, PWAVEFORMATEX format);
 
-    NTSTATUS sst_program_dma(eDeviceType deviceType, UINT32 byteCount, PMDL mdl, IPortWaveRTStream* stream);
+    NTSTATUS sst_program_dma(eDeviceType deviceType, UINT32 byteCount, PMDL mdl, IPortWaveRTStream* stream, PWAVEFORMATEXTENSIBLE format);
     NTSTATUS sst_play(eDeviceType deviceType);
     NTSTATUS sst_stop(eDeviceType deviceType);
     void force_stop(catpt_stream* stream);
+    void free_page_table(catpt_stream* stream);
     NTSTATUS sst_current_position(eDeviceType deviceType, UINT32* linkPos, UINT64* linearPos);
+    NTSTATUS sst_set_write_position(eDeviceType deviceType, UINT32 writePos);
+    void sst_release_buffer(PMDL mdl);
+    const struct catpt_boot_times* sst_boot_times();
+    const struct catpt_dx_times* sst_dx_times();
+    const struct catpt_clock_stats* sst_clock_stats();
+    void sst_set_lpclock_idle(ULONG ms);
     
     void                        MixerReset();
     BOOL                        bGetDevSpecific();
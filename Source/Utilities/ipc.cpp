@@ -11,6 +11,9 @@ void CCsAudioCatptSSTHW::ipc_init() {
 	this->ipc_ready = false;
 	this->ipc_done = false;
 	this->ipc_busy = false;
+
+	KeInitializeEvent(&this->fw_ready_event, NotificationEvent, FALSE);
+	KeInitializeDpc(&this->fw_ready_dpc_obj, CCsAudioCatptSSTHW::fw_ready_dpc, this);
 }
 
 NTSTATUS CCsAudioCatptSSTHW::ipc_arm(struct catpt_fw_ready* config)
@@ -20,6 +23,8 @@ NTSTATUS CCsAudioCatptSSTHW::ipc_arm(struct catpt_fw_ready* config)
 	 * only used for notifications where payload size is known upfront,
 	 * thus no separate buffer is allocated for it.
 	 */
+	if (this->ipc_rx.data)
+		ExFreePoolWithTag(this->ipc_rx.data, CSAUDIOCATPTSST_POOLTAG);
 	this->ipc_rx.data = ExAllocatePoolZero(NonPagedPool, config->outbox_size, CSAUDIOCATPTSST_POOLTAG);
 	if (!this->ipc_rx.data)
 		return STATUS_NO_MEMORY;
@@ -32,6 +37,17 @@ NTSTATUS CCsAudioCatptSSTHW::ipc_arm(struct catpt_fw_ready* config)
 
 NTSTATUS CCsAudioCatptSSTHW::ipc_send_msg(struct catpt_ipc_msg request,
 	struct catpt_ipc_msg* reply, int timeout) {
+#if DBG
+	if (this->ipc_capture) {
+		struct catpt_ipc_capture* cap = this->ipc_capture;
+
+		cap->count++;
+		cap->header = request.header;
+		cap->size = request.size;
+		RtlCopyMemory(cap->data, request.data, min(request.size, sizeof(cap->data)));
+		return STATUS_SUCCESS;
+	}
+#endif
 	if (!this->ipc_ready) {
 		return STATUS_NO_SUCH_DEVICE;
 	}
@@ -141,6 +157,7 @@ void CCsAudioCatptSSTHW::dsp_notify_stream(union catpt_notify_msg msg) {
 	switch (msg.notify_reason) {
 	case CATPT_NOTIFY_POSITION_CHANGED:
 		memcpy_io(&pos, catpt_inbox_addr(this), sizeof(pos));
+		stream_update_position(stream, &pos);
 		break;
 
 	case CATPT_NOTIFY_GLITCH_OCCURRED:
@@ -158,19 +175,35 @@ void CCsAudioCatptSSTHW::dsp_notify_stream(union catpt_notify_msg msg) {
 	}
 }
 
+_Use_decl_annotations_
+VOID NTAPI CCsAudioCatptSSTHW::fw_ready_dpc(PKDPC Dpc, PVOID DeferredContext, PVOID SystemArgument1, PVOID SystemArgument2) {
+	UNREFERENCED_PARAMETER(Dpc);
+	UNREFERENCED_PARAMETER(SystemArgument1);
+	UNREFERENCED_PARAMETER(SystemArgument2);
+
+	CCsAudioCatptSSTHW* that = (CCsAudioCatptSSTHW*)DeferredContext;
+	NTSTATUS status = that->ipc_arm(&that->fw_ready_config);
+	if (!NT_SUCCESS(status)) {
+		DPF(D_ERROR, "Unable to arm IPC: 0x%x\n", status);
+	}
+
+	/* the waiter in catpt_boot_firmware() picks the result up */
+	that->fw_ready_status = status;
+	that->fw_ready = NT_SUCCESS(status);
+	KeSetEvent(&that->fw_ready_event, IO_NO_INCREMENT, FALSE);
+}
+
 void CCsAudioCatptSSTHW::dsp_process_response(UINT32 header)
 {
 	union catpt_notify_msg msg = CATPT_MSG(header);
 
 	if (msg.fw_ready) {
-		struct catpt_fw_ready config;
 		/* to fit 32b header original address is shifted right by 3 */
 		UINT32 off = msg.mailbox_address << 3;
 
-		memcpy_io(&config, this->lpe_ba + off, sizeof(config));
-
-		ipc_arm(&config);
-		this->fw_ready = true;
+		/* the mailbox is read here, arming allocates so it waits for the DPC */
+		memcpy_io(&this->fw_ready_config, this->lpe_ba + off, sizeof(this->fw_ready_config));
+		KeInsertQueueDpc(&this->fw_ready_dpc_obj, NULL, NULL);
 		return;
 	}
 
@@ -251,5 +284,18 @@ NTSTATUS CCsAudioCatptSSTHW::dsp_irq_handler() {
 		status = STATUS_SUCCESS;
 	}
 
+	/* firmware block loads complete through the shared line too */
+	if (this->dmac && this->dmac->irq_handler())
+		status = STATUS_SUCCESS;
+
 	return status;
+}
+
+/* runs under the interrupt lock, so the ISR is never inside dmac after this */
+NTSTATUS CCsAudioCatptSSTHW::dsp_detach_dmac() {
+	if (this->dmac) {
+		this->dmac->irq_quiesce();
+		this->dmac = NULL;
+	}
+	return STATUS_SUCCESS;
 }
\ No newline at end of file
@@ -77,9 +77,9 @@ PRESOURCE CCsAudioCatptSSTHW::catpt_request_region(PRESOURCE root, size_t size)
 	return __request_region(root, addr, size, 0);
 }
 
-NTSTATUS CCsAudioCatptSSTHW::catpt_load_block(PHYSICAL_ADDRESS pAddr, struct catpt_fw_block_hdr* blk, bool alloc)
+/* Describe the copy of one block from the image into its SRAM window. */
+void CCsAudioCatptSSTHW::catpt_load_block(PHYSICAL_ADDRESS pAddr, struct catpt_fw_block_hdr* blk, struct dw_dma_sg* sg)
 {
-	NTSTATUS status;
 	PRESOURCE sram;
 
 	switch (blk->ram_type) {
@@ -91,51 +91,121 @@ NTSTATUS CCsAudioCatptSSTHW::catpt_load_block(PHYSICAL_ADDRESS pAddr, struct cat
 		break;
 	}
 
-	UINT32 dst_addr = (UINT32)(sram->start + blk->ram_offset);
-	//TODO: mark region as busy
+	/* advance to data area */
+	pAddr.QuadPart += sizeof(*blk);
+
+	sg->dst = (UINT32)(sram->start + blk->ram_offset) | CATPT_DMA_DSP_ADDR_MASK;
+	sg->src = pAddr.LowPart;
+	sg->len = blk->size;
+}
 
-	if (alloc) {
-		PRESOURCE res = __request_region(sram, dst_addr, blk->size, 0);
-		if (!res) {
-			return STATUS_DEVICE_BUSY;
-		}
+static UINT32 catpt_fnv1a(UINT32 hash, const void* data, SIZE_T size)
+{
+	const UINT8* p = (const UINT8*)data;
+
+	for (SIZE_T i = 0; i < size; i++) {
+		hash ^= p[i];
+		hash *= 0x01000193;
 	}
+	return hash;
+}
 
-	dst_addr |= CATPT_DMA_DSP_ADDR_MASK;
+/*
+ * FNV-1a over the firmware, module and block headers only, a few hundred
+ * bytes of a ~300 KB image. They hold everything the manifest was built
+ * from, so a stray write there would send the DMA to the wrong place;
+ * block payloads are not covered. A walk that runs off the image stops
+ * early and so hashes differently.
+ */
+static UINT32 catpt_image_hash(const UINT8* image, SIZE_T size)
+{
+	const struct catpt_fw_hdr* fw = (const struct catpt_fw_hdr*)image;
+	UINT32 hash = 0x811c9dc5;
+	SIZE_T offset = sizeof(*fw);
 
-	/* advance to data area */
-	pAddr.QuadPart += sizeof(*blk);
+	if (size < sizeof(*fw))
+		return 0;
+	hash = catpt_fnv1a(hash, fw, sizeof(*fw));
 
-	//TODO: dma_memcpy_todsp
-	status = this->dmac->transfer_dma(dst_addr, pAddr.LowPart, blk->size);
+	for (UINT32 i = 0; i < fw->modules; i++) {
+		const struct catpt_fw_mod_hdr* mod;
+		SIZE_T end;
 
-	if (!NT_SUCCESS(status)) {
-		__release_region(sram, dst_addr, blk->size);
-	}
+		if (offset + sizeof(*mod) > size)
+			break;
+		mod = (const struct catpt_fw_mod_hdr*)(image + offset);
+		hash = catpt_fnv1a(hash, mod, sizeof(*mod));
+		end = offset + sizeof(*mod) + mod->mod_size;
+		if (end > size)
+			break;
 
-	return status;
+		offset += sizeof(*mod);
+		for (UINT32 j = 0; j < mod->blocks; j++) {
+			const struct catpt_fw_block_hdr* blk;
+
+			if (offset + sizeof(*blk) > end)
+				break;
+			blk = (const struct catpt_fw_block_hdr*)(image + offset);
+			hash = catpt_fnv1a(hash, blk, sizeof(*blk));
+			offset += sizeof(*blk) + blk->size;
+		}
+		offset = end;
+	}
+	return hash;
 }
 
-NTSTATUS CCsAudioCatptSSTHW::catpt_load_module(PHYSICAL_ADDRESS paddr, struct catpt_fw_mod_hdr* mod)
+/*
+ * Record the module's static info and a window per block. A deferred
+ * module's windows are reserved at boot like any other so the layout stays
+ * fixed, but they are flagged so their SRAM stays gated and are not copied;
+ * catpt_load_deferred() brings the module in later. Every block has to fit
+ * its module and its SRAM, the windows are replayed without another look.
+ */
+NTSTATUS CCsAudioCatptSSTHW::catpt_index_module(PHYSICAL_ADDRESS paddr, UINT32 image_offset,
+	struct catpt_fw_mod_hdr* mod, bool defer, struct catpt_fw_manifest* man)
 {
 	struct catpt_module_type* type;
 	UINT32 offset = sizeof(*mod);
+	UINT32 end = sizeof(*mod) + mod->mod_size;
 
-	type = &this->modules[mod->module_id];
+	type = &man->modules[mod->module_id];
 
 	for (UINT32 i = 0; i < mod->blocks; i++) {
 		struct catpt_fw_block_hdr* blk;
-		NTSTATUS status;
+		struct catpt_fw_window* win;
+		PRESOURCE sram;
 
+		if (offset + sizeof(*blk) > end) {
+			DPF(D_ERROR, "module %d block %d header past module end\n",
+				mod->module_id, i);
+			return STATUS_INVALID_PARAMETER;
+		}
 		blk = (struct catpt_fw_block_hdr*)((UINT8*)mod + offset);
+		if (blk->size > end - offset - sizeof(*blk)) {
+			DPF(D_ERROR, "module %d block %d size 0x%x past module end\n",
+				mod->module_id, i, blk->size);
+			return STATUS_INVALID_PARAMETER;
+		}
+
+		sram = blk->ram_type == CATPT_RAM_TYPE_IRAM ? &this->iram : &this->dram;
+		if (blk->ram_offset > resource_size(sram) ||
+			blk->size > resource_size(sram) - blk->ram_offset) {
+			DPF(D_ERROR, "module %d block %d at 0x%x+0x%x does not fit %s\n",
+				mod->module_id, i, blk->ram_offset, blk->size,
+				blk->ram_type == CATPT_RAM_TYPE_IRAM ? "IRAM" : "DRAM");
+			return STATUS_INVALID_PARAMETER;
+		}
+
+		win = &man->windows[man->count++];
 
 		PHYSICAL_ADDRESS blockPaddr;
 		blockPaddr.QuadPart = paddr.QuadPart + offset;
-		status = catpt_load_block(blockPaddr, blk, true);
-		if (!NT_SUCCESS(status)) {
-			CatPtPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "load block failed: 0x%x\n", status);
-			return status;
-		}
+		catpt_load_block(blockPaddr, blk, &win->sg);
+		win->module_id = mod->module_id;
+		win->iram = blk->ram_type == CATPT_RAM_TYPE_IRAM;
+		win->instance = blk->ram_type == CATPT_RAM_TYPE_INSTANCE;
+		win->deferred = defer;
+
 		/*
 		 * Save state window coordinates - these will be
 		 * used to capture module state on D0 exit.
@@ -149,23 +219,36 @@ NTSTATUS CCsAudioCatptSSTHW::catpt_load_module(PHYSICAL_ADDRESS paddr, struct ca
 	}
 
 	/* init module type static info */
-	type->loaded = true;
+	type->loaded = !defer;
 	/* DSP expects address from module header substracted by 4 */
 	type->entry_point = mod->entry_point - 4;
 	type->persistent_size = mod->persistent_size;
 	type->scratch_size = mod->scratch_size;
-
+	type->image_offset = image_offset;
 	return STATUS_SUCCESS;
 }
 
-NTSTATUS CCsAudioCatptSSTHW::catpt_load_firmware(PHYSICAL_ADDRESS paddr, struct catpt_fw_hdr* fw) {
+/*
+ * Walk the header chain once, when the image is read from disk, and keep
+ * the result for as long as the image stays resident. Every later boot
+ * replays the manifest instead of parsing the image again.
+ */
+NTSTATUS CCsAudioCatptSSTHW::catpt_index_image(PHYSICAL_ADDRESS paddr, struct catpt_fw_hdr* fw, SIZE_T size)
+{
+	struct catpt_fw_manifest* man;
+	struct catpt_fw_mod_hdr* mod;
 	UINT32 offset = sizeof(*fw);
+	UINT32 nblocks = 0;
+	UINT32 deferred = 0;
+	NTSTATUS status;
+	bool lazy;
 
 	for (UINT32 i = 0; i < fw->modules; i++) {
-		struct catpt_fw_mod_hdr* mod;
-		NTSTATUS status;
-
+		if (offset + sizeof(*mod) > size)
+			return STATUS_INVALID_PARAMETER;
 		mod = (struct catpt_fw_mod_hdr*)((UINT8*)fw + offset);
+		if (mod->mod_size > size - offset - sizeof(*mod))
+			return STATUS_INVALID_PARAMETER;
 		if (strncmp(fw->signature, mod->signature,
 			FW_SIGNATURE_SIZE)) {
 			DPF(D_ERROR, "module signature mismatch\n");
@@ -175,26 +258,295 @@ NTSTATUS CCsAudioCatptSSTHW::catpt_load_firmware(PHYSICAL_ADDRESS paddr, struct
 		if (mod->module_id > CATPT_MODID_LAST)
 			return STATUS_INVALID_PARAMETER;
 
+		nblocks += mod->blocks;
+		offset += sizeof(*mod) + mod->mod_size;
+	}
+
+	if (!nblocks)
+		return STATUS_INVALID_PARAMETER;
+
+	man = (struct catpt_fw_manifest*)ExAllocatePoolZero(NonPagedPool,
+		FIELD_OFFSET(struct catpt_fw_manifest, windows) + nblocks * sizeof(struct catpt_fw_window),
+		CSAUDIOCATPTSST_POOLTAG);
+	if (!man)
+		return STATUS_NO_MEMORY;
+
+	/* deferred modules are copied from the image, which must stay around */
+	lazy = size <= DMA_POOL_FW_RESIDENT_MAX;
+
+	offset = sizeof(*fw);
+	for (UINT32 i = 0; i < fw->modules; i++) {
+		mod = (struct catpt_fw_mod_hdr*)((UINT8*)fw + offset);
+
 		PHYSICAL_ADDRESS modulePaddr;
 		modulePaddr.QuadPart = paddr.QuadPart + offset;
-		status = catpt_load_module(modulePaddr, mod);
+		status = catpt_index_module(modulePaddr, offset, mod,
+			lazy && !catpt_module_eager(mod->module_id), man);
 		if (!NT_SUCCESS(status)) {
-			CatPtPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "load module failed: 0x%x\n", status);
+			ExFreePoolWithTag(man, CSAUDIOCATPTSST_POOLTAG);
 			return status;
 		}
 
 		offset += sizeof(*mod) + mod->mod_size;
 	}
+
+	man->image_size = (UINT32)size;
+	man->image_hash = catpt_image_hash((UINT8*)fw, size);
+
+	/*
+	 * The stock IntcSST2.bin keeps all code in BASE_FW, so this is
+	 * normally 0 and the boot copies everything, exactly as without
+	 * deferral. Images with their own decoder code get the saving.
+	 */
+	for (UINT32 i = 0; i < man->count; i++)
+		deferred += man->windows[i].deferred;
+	CatPtPrint(DEBUG_LEVEL_VERBOSE, DBG_PNP, "%u of %u blocks deferred\n", deferred, man->count);
+
+	if (this->fw_manifest)
+		ExFreePoolWithTag(this->fw_manifest, CSAUDIOCATPTSST_POOLTAG);
+	this->fw_manifest = man;
 	return STATUS_SUCCESS;
 }
 
+static void catpt_dx_window(struct dw_dma_sg* sg, PRESOURCE dram, PHYSICAL_ADDRESS dxAddr,
+	UINT32 addr, UINT32 size, BOOL toDsp)
+{
+	UINT32 host = dxAddr.LowPart + (addr - (UINT32)dram->start);
+
+	if (toDsp) {
+		sg->dst = addr | CATPT_DMA_DSP_ADDR_MASK;
+		sg->src = host;
+	}
+	else {
+		/* dsp_dma_sg_fromdsp() applies the mask */
+		sg->dst = host;
+		sg->src = addr;
+	}
+	sg->len = size;
+}
+
+/*
+ * DRAM windows that only exist in the DX buffer while in D3: the memory
+ * dumps listed in the DX context and the persistent area of every live
+ * stream. Each keeps its DRAM offset within the buffer.
+ */
+UINT32 CCsAudioCatptSSTHW::catpt_dx_windows(struct dw_dma_sg* sg, PHYSICAL_ADDRESS dxAddr, BOOL toDsp)
+{
+	UINT32 count = 0;
+
+	for (UINT32 i = 0; i < this->dx_ctx.num_meminfo; i++) {
+		struct catpt_save_meminfo* info = &this->dx_ctx.meminfo[i];
+		UINT32 off, size;
+
+		if (info->source != CATPT_DX_TYPE_MEMORY_DUMP)
+			continue;
+
+		off = catpt_to_host_offset(info->offset);
+		if (off < this->dram.start || off > this->dram.end || !info->size)
+			continue;
+		size = min(info->size, (UINT32)(this->dram.end - off + 1));
+
+		catpt_dx_window(&sg[count++], &this->dram, dxAddr, off, size, toDsp);
+	}
+
+	for (int i = 0; i < eMaxDeviceType; i++) {
+		struct catpt_stream* stream = &this->streams[i];
+
+		if (!stream->allocated || !stream->persistent)
+			continue;
+
+		catpt_dx_window(&sg[count++], &this->dram, dxAddr,
+			(UINT32)stream->persistent->start, (UINT32)resource_size(stream->persistent), toDsp);
+	}
+
+	return count;
+}
+
+/*
+ * Save everything catpt_dx_windows() covers plus each loaded module's
+ * state window, all in one chain. The DSP has to be stalled in DX state.
+ */
+NTSTATUS CCsAudioCatptSSTHW::catpt_store_context(PHYSICAL_ADDRESS dxAddr)
+{
+	struct dw_dma_sg sg[CATPT_DMA_SG_MAX];
+	UINT32 count;
+
+	count = catpt_dx_windows(sg, dxAddr, FALSE);
+
+	for (UINT32 i = 0; i < CATPT_MODULE_COUNT; i++) {
+		struct catpt_module_type* type = &this->modules[i];
+
+		if (!type->loaded || !type->state_size)
+			continue;
+
+		catpt_dx_window(&sg[count++], &this->dram, dxAddr,
+			(UINT32)this->dram.start + type->state_offset, type->state_size, FALSE);
+	}
+
+	if (!count)
+		return STATUS_SUCCESS;
+	return dsp_dma_sg_fromdsp(sg, count);
+}
+
+/*
+ * One manifest window on resume. Code comes from the image again, a
+ * module's state window from the DX buffer. Of the base firmware's DRAM
+ * only the parts the DX context marks as image are reloaded, the rest is
+ * either a memory dump or scratch.
+ */
+UINT32 CCsAudioCatptSSTHW::catpt_restore_window(struct catpt_fw_window* win,
+	PHYSICAL_ADDRESS dxAddr, struct dw_dma_sg* sg)
+{
+	UINT32 start = win->sg.dst & ~CATPT_DMA_DSP_ADDR_MASK;
+	UINT32 end = start + win->sg.len;
+	UINT32 count = 0;
+
+	if (win->iram) {
+		sg[0] = win->sg;
+		return 1;
+	}
+
+	if (win->module_id != CATPT_MODID_BASE_FW) {
+		if (win->instance)
+			catpt_dx_window(&sg[0], &this->dram, dxAddr, start, win->sg.len, TRUE);
+		else
+			sg[0] = win->sg;
+		return 1;
+	}
+
+	for (UINT32 j = 0; j < this->dx_ctx.num_meminfo; j++) {
+		struct catpt_save_meminfo* info = &this->dx_ctx.meminfo[j];
+		UINT32 lo, hi;
+
+		if (info->source != CATPT_DX_TYPE_FW_IMAGE)
+			continue;
+
+		lo = max(catpt_to_host_offset(info->offset), start);
+		hi = min(catpt_to_host_offset(info->offset) + info->size, end);
+		if (lo >= hi)
+			continue;
+
+		sg[count].dst = lo | CATPT_DMA_DSP_ADDR_MASK;
+		sg[count].src = win->sg.src + (lo - start);
+		sg[count].len = hi - lo;
+		count++;
+	}
+
+	return count;
+}
+
+/*
+ * Reserve the SRAM windows listed in the manifest and copy the blocks of
+ * the modules needed at boot with a single DMA chain. On resume the SRAM
+ * is still reserved; the modules that were loaded are rebuilt from the
+ * image and the list also brings back the context saved by
+ * catpt_store_context().
+ */
+NTSTATUS CCsAudioCatptSSTHW::catpt_load_firmware(BOOL restore) {
+	struct catpt_fw_manifest* man = this->fw_manifest;
+	struct dw_dma_sg* sg;
+	PHYSICAL_ADDRESS dxAddr;
+	UINT32 nblocks = man->count;
+	UINT32 count = 0;
+	NTSTATUS status = STATUS_SUCCESS;
+
+	if (restore && !this->dmapool->dx_region(&dxAddr))
+		return STATUS_NO_MEMORY;
+
+	/* base firmware blocks may be cut up by the image ranges of the DX context */
+	if (restore)
+		nblocks += (nblocks + 1) * this->dx_ctx.num_meminfo + eMaxDeviceType;
+
+	sg = (struct dw_dma_sg*)ExAllocatePoolZero(NonPagedPool, nblocks * sizeof(*sg), CSAUDIOCATPTSST_POOLTAG);
+	if (!sg)
+		return STATUS_NO_MEMORY;
+
+	if (restore) {
+		for (UINT32 i = 0; i < man->count; i++) {
+			struct catpt_fw_window* win = &man->windows[i];
+
+			if (this->modules[win->module_id].loaded)
+				count += catpt_restore_window(win, dxAddr, &sg[count]);
+		}
+
+		count += catpt_dx_windows(&sg[count], dxAddr, TRUE);
+	}
+	else {
+		RtlCopyMemory(this->modules, man->modules, sizeof(this->modules));
+
+		for (UINT32 i = 0; i < man->count; i++) {
+			struct catpt_fw_window* win = &man->windows[i];
+			UINT32 addr = win->sg.dst & ~CATPT_DMA_DSP_ADDR_MASK;
+
+			if (!__request_region(win->iram ? &this->iram : &this->dram, addr, win->sg.len,
+				win->deferred ? IORESOURCE_DISABLED : 0)) {
+				CatPtPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "window 0x%x busy\n", addr);
+				status = STATUS_DEVICE_BUSY;
+				goto release;
+			}
+
+			if (!win->deferred)
+				sg[count++] = win->sg;
+		}
+	}
+
+	status = this->dmac->transfer_dma_sg(sg, count);
+	if (NT_SUCCESS(status)) {
+		struct dw_dma_stats stats;
+
+		this->dmac->get_stats(&stats);
+		CatPtPrint(DEBUG_LEVEL_VERBOSE, DBG_PNP, "DMA: %llu copies, %llu bytes in %llu us, max queue %u\n",
+			stats.completed, stats.bytes, stats.busyTime / 10, stats.maxQueueDepth);
+		goto out;
+	}
+	CatPtPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "image transfer failed: 0x%x\n", status);
+
+release:
+	/*
+	 * On resume the regions stay with the context being restored.
+	 * Otherwise the image was all that occupied the SRAM.
+	 */
+	if (!restore) {
+		sram_free(&this->iram);
+		sram_free(&this->dram);
+	}
+	RtlZeroMemory(this->modules, sizeof(this->modules));
+
+out:
+	ExFreePoolWithTag(sg, CSAUDIOCATPTSST_POOLTAG);
+	return status;
+}
+
+/*
+ * The image is read from disk on the first boot only. It stays in the
+ * pool's firmware region afterwards together with its manifest, so a
+ * resume skips the file I/O and the parsing and goes straight to the DMA.
+ */
 NTSTATUS CCsAudioCatptSSTHW::catpt_load_image(PCWSTR path, BOOL restore) {
-	NTSTATUS status;
+	NTSTATUS status = STATUS_SUCCESS;
 	struct firmware* img;
 	struct catpt_fw_hdr* fw;
+	PHYSICAL_ADDRESS paddr;
+	SIZE_T size;
+	void* vaddr;
 
 	const char* signature = FW_SIGNATURE;
 
+	/*
+	 * The resident copy sits in DMA-able memory for the life of the
+	 * driver. Anything that scribbled over its headers would point the
+	 * DMA elsewhere, so check them against the manifest before every boot.
+	 */
+	vaddr = this->dmapool->fw_image(&size, &paddr);
+	if (vaddr && this->fw_manifest) {
+		if (this->fw_manifest->image_size == size &&
+			this->fw_manifest->image_hash == catpt_image_hash((UINT8*)vaddr, size))
+			goto load;
+
+		DPF(D_ERROR, "resident firmware image corrupt, reading it again\n");
+		this->dmapool->fw_drop();
+	}
+
 	status = request_firmware((const struct firmware**)&img, path);
 	if (!NT_SUCCESS(status)) {
 		return status;
@@ -206,30 +558,109 @@ NTSTATUS CCsAudioCatptSSTHW::catpt_load_image(PCWSTR path, BOOL restore) {
 		goto release_fw;
 	}
 
-	PHYSICAL_ADDRESS maxAddr;
-	maxAddr.QuadPart = MAXULONG32;
-	void* vaddr;
-	vaddr = MmAllocateContiguousMemory(img->size, maxAddr);
+	size = img->size;
+	vaddr = this->dmapool->fw_region(size, &paddr);
 	if (!vaddr) {
 		status = STATUS_NO_MEMORY;
 		goto release_fw;
 	}
-	memcpy(vaddr, img->data, img->size);
+	memcpy(vaddr, img->data, size);
+	free_firmware(img);
+
+	status = catpt_index_image(paddr, (struct catpt_fw_hdr*)vaddr, size);
+	if (!NT_SUCCESS(status)) {
+		this->dmapool->fw_drop();
+		return status;
+	}
+
+load:
+	status = catpt_load_firmware(restore);
 
+	if (NT_SUCCESS(status))
+		this->dmapool->fw_keep(size);
+	else
+		this->dmapool->fw_drop();
+	return status;
+
+release_fw:
+	free_firmware(img);
+	return status;
+}
+
+static void catpt_set_deferred(PRESOURCE sram, UINT32 addr, BOOL deferred)
+{
+	PRESOURCE res;
+
+	for (res = sram->child; res; res = res->sibling) {
+		if (res->start != addr)
+			continue;
+		if (deferred)
+			res->flags |= IORESOURCE_DISABLED;
+		else
+			res->flags &= ~IORESOURCE_DISABLED;
+		return;
+	}
+}
+
+/*
+ * Copy a module left out at boot from the resident image into its reserved
+ * windows. The DSP keeps running; nothing references the module until a
+ * stream carrying it is allocated. Its SRAM is ungated first.
+ */
+NTSTATUS CCsAudioCatptSSTHW::catpt_load_deferred(UINT16 module_id)
+{
+	struct catpt_module_type* type = &this->modules[module_id];
+	struct catpt_fw_manifest* man = this->fw_manifest;
+	struct dw_dma_sg* sg;
 	PHYSICAL_ADDRESS paddr;
-	paddr = MmGetPhysicalAddress(vaddr);
+	SIZE_T size;
+	UINT32 count = 0;
+	NTSTATUS status;
 
-	fw = (struct catpt_fw_hdr*)vaddr;
-	if (restore) {
-		//TODO: restore
+	if (type->loaded)
+		return STATUS_SUCCESS;
+
+	if (!man || !type->image_offset || !this->dmapool->fw_image(&size, &paddr))
+		return STATUS_NOT_SUPPORTED;
+
+	sg = (struct dw_dma_sg*)ExAllocatePoolZero(NonPagedPool, man->count * sizeof(*sg), CSAUDIOCATPTSST_POOLTAG);
+	if (!sg)
+		return STATUS_NO_MEMORY;
+
+	for (UINT32 i = 0; i < man->count; i++) {
+		struct catpt_fw_window* win = &man->windows[i];
+
+		if (win->module_id != module_id)
+			continue;
+
+		catpt_set_deferred(win->iram ? &this->iram : &this->dram,
+			win->sg.dst & ~CATPT_DMA_DSP_ADDR_MASK, FALSE);
+		sg[count++] = win->sg;
+	}
+
+	dsp_update_srampge(&this->dram, this->spec->dram_mask);
+	dsp_update_srampge(&this->iram, this->spec->iram_mask);
+
+	status = this->dmac->transfer_dma_sg(sg, count);
+	if (NT_SUCCESS(status)) {
+		type->loaded = true;
+		CatPtPrint(DEBUG_LEVEL_VERBOSE, DBG_IOCTL, "module %d loaded on demand\n", module_id);
 	}
 	else {
-		status = catpt_load_firmware(paddr, fw);
+		CatPtPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "module %d transfer failed: 0x%x\n", module_id, status);
+
+		for (UINT32 i = 0; i < man->count; i++) {
+			struct catpt_fw_window* win = &man->windows[i];
+
+			if (win->module_id == module_id)
+				catpt_set_deferred(win->iram ? &this->iram : &this->dram,
+					win->sg.dst & ~CATPT_DMA_DSP_ADDR_MASK, TRUE);
+		}
+		dsp_update_srampge(&this->dram, this->spec->dram_mask);
+		dsp_update_srampge(&this->iram, this->spec->iram_mask);
 	}
 
-	MmFreeContiguousMemory(vaddr);
-release_fw:
-	free_firmware(img);
+	ExFreePoolWithTag(sg, CSAUDIOCATPTSST_POOLTAG);
 	return status;
 }
 
@@ -243,21 +674,31 @@ NTSTATUS CCsAudioCatptSSTHW::catpt_boot_firmware(BOOL restore) {
 		CatPtPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Load binaries failed: 0x%x\n", status);
 		return status;
 	}
+	boot_mark(CATPT_BOOT_DMA_LOAD);
 
 	this->fw_ready = FALSE;
+	this->fw_ready_status = STATUS_PENDING;
+	KeClearEvent(&this->fw_ready_event);
 	dsp_stall(false);
-
-	LARGE_INTEGER StartTime;
-	KeQuerySystemTimePrecise(&StartTime);
-	while (this->fw_ready == FALSE) {
-		LARGE_INTEGER CurrentTime;
-		KeQuerySystemTimePrecise(&CurrentTime);
-
-		if (((CurrentTime.QuadPart - StartTime.QuadPart) / (10 * 1000)) >= FW_READY_TIMEOUT_MS) {
-			DPF(D_ERROR, "Firmware ready timeout\n");
-			return STATUS_TIMEOUT;
-		}
+	boot_mark(CATPT_BOOT_STALL_RELEASE);
+
+	LARGE_INTEGER Timeout;
+	Timeout.QuadPart = -10LL * 1000 * FW_READY_TIMEOUT_MS;
+	status = KeWaitForSingleObject(&this->fw_ready_event, Executive, KernelMode, FALSE, &Timeout);
+	if (status == STATUS_TIMEOUT) {
+		DPF(D_ERROR, "Firmware ready timeout\n");
+		/* STATUS_TIMEOUT is a success code */
+		status = STATUS_IO_TIMEOUT;
+		goto drop;
+	}
+	status = this->fw_ready_status;
+	if (!NT_SUCCESS(status))
+		goto drop;
+	if (!this->ipc_ready) {
+		status = STATUS_NO_SUCH_DEVICE;
+		goto drop;
 	}
+	boot_mark(CATPT_BOOT_FW_READY);
 	DPF(D_ERROR, "Firmware ready!!!\n");
 
 	/* update sram pg & clock once done booting */
@@ -265,4 +706,111 @@ NTSTATUS CCsAudioCatptSSTHW::catpt_boot_firmware(BOOL restore) {
 	dsp_update_srampge(&this->iram, this->spec->iram_mask);
 
 	return dsp_update_lpclock();
-}
\ No newline at end of file
+
+drop:
+	/* the copy that did not boot is not trusted for the next attempt */
+	this->dmapool->fw_drop();
+	return status;
+}
+#if DBG
+static UINT8* catpt_test_module(UINT8* p, UINT16 module_id, UINT32 blocks, UINT32 mod_size)
+{
+	struct catpt_fw_mod_hdr* mod = (struct catpt_fw_mod_hdr*)p;
+
+	RtlCopyMemory(mod->signature, FW_SIGNATURE, FW_SIGNATURE_SIZE);
+	mod->module_id = module_id;
+	mod->blocks = blocks;
+	mod->mod_size = mod_size;
+	return p + sizeof(*mod);
+}
+
+static UINT8* catpt_test_block(UINT8* p, UINT32 ram_type, UINT32 ram_offset, UINT32 size)
+{
+	struct catpt_fw_block_hdr* blk = (struct catpt_fw_block_hdr*)p;
+
+	blk->ram_type = ram_type;
+	blk->ram_offset = ram_offset;
+	blk->size = size;
+	RtlFillMemory(p + sizeof(*blk), size, 0xA5);
+	return p + sizeof(*blk) + size;
+}
+
+/*
+ * The stock IntcSST2.bin keeps all code in BASE_FW, so it never defers
+ * anything. Index a synthetic image instead: BASE_FW, the system PCM
+ * module a template references and an MP3 decoder no template uses. Only
+ * the MP3 windows come out deferred, with the module unloaded but its
+ * state window and image offset recorded for catpt_load_deferred(). The
+ * header hash ignores payload bytes and sees header ones, and a block
+ * larger than its module is refused.
+ */
+void CCsAudioCatptSSTHW::catpt_check_deferred()
+{
+	const UINT32 blk = sizeof(struct catpt_fw_block_hdr);
+	const UINT32 mod = sizeof(struct catpt_fw_mod_hdr);
+	struct catpt_fw_manifest* saved = this->fw_manifest;
+	struct catpt_fw_manifest* man;
+	struct catpt_fw_hdr* fw;
+	PHYSICAL_ADDRESS paddr;
+	UINT32 mp3, size, hash;
+	UINT8* image;
+	UINT8* p;
+
+	image = (UINT8*)ExAllocatePoolZero(NonPagedPool, PAGE_SIZE, CSAUDIOCATPTSST_POOLTAG);
+	if (!image)
+		return;
+	paddr.QuadPart = 0x10000000;
+
+	fw = (struct catpt_fw_hdr*)image;
+	RtlCopyMemory(fw->signature, FW_SIGNATURE, FW_SIGNATURE_SIZE);
+	fw->modules = 3;
+	p = image + sizeof(*fw);
+	p = catpt_test_module(p, CATPT_MODID_BASE_FW, 1, blk + 16);
+	p = catpt_test_block(p, CATPT_RAM_TYPE_IRAM, 0, 16);
+	p = catpt_test_module(p, CATPT_MODID_PCM_SYSTEM, 1, blk + 16);
+	p = catpt_test_block(p, CATPT_RAM_TYPE_DRAM, 0x100, 16);
+	mp3 = (UINT32)(p - image);
+	p = catpt_test_module(p, CATPT_MODID_MP3, 2, 2 * blk + 16 + 8);
+	p = catpt_test_block(p, CATPT_RAM_TYPE_IRAM, 0x200, 16);
+	p = catpt_test_block(p, CATPT_RAM_TYPE_INSTANCE, 0x300, 8);
+	size = (UINT32)(p - image);
+	fw->file_size = size;
+
+	this->fw_manifest = NULL;
+	ASSERT(NT_SUCCESS(catpt_index_image(paddr, fw, size)));
+	man = this->fw_manifest;
+	if (man) {
+		ASSERT(man->count == 4);
+		ASSERT(!man->windows[0].deferred && !man->windows[1].deferred);
+		ASSERT(man->windows[2].deferred && man->windows[3].deferred);
+		ASSERT(man->windows[2].module_id == CATPT_MODID_MP3 && man->windows[2].iram);
+		ASSERT(man->windows[2].sg.src == paddr.LowPart + mp3 + mod + blk);
+		ASSERT(man->windows[2].sg.dst == ((UINT32)(this->iram.start + 0x200) | CATPT_DMA_DSP_ADDR_MASK));
+		ASSERT(man->windows[3].instance);
+
+		ASSERT(man->modules[CATPT_MODID_BASE_FW].loaded);
+		ASSERT(man->modules[CATPT_MODID_PCM_SYSTEM].loaded);
+		ASSERT(!man->modules[CATPT_MODID_MP3].loaded);
+		ASSERT(man->modules[CATPT_MODID_MP3].image_offset == mp3);
+		ASSERT(man->modules[CATPT_MODID_MP3].state_offset == 0x300 &&
+			man->modules[CATPT_MODID_MP3].state_size == 8);
+
+		hash = man->image_hash;
+		image[mp3 + mod + blk] ^= 0xFF;
+		ASSERT(catpt_image_hash(image, size) == hash);
+		image[mp3 + mod] ^= 0xFF;
+		ASSERT(catpt_image_hash(image, size) != hash);
+		image[mp3 + mod] ^= 0xFF;
+
+		ExFreePoolWithTag(man, CSAUDIOCATPTSST_POOLTAG);
+		this->fw_manifest = NULL;
+	}
+
+	((struct catpt_fw_block_hdr*)(image + mp3 + mod))->size = 0x1000;
+	ASSERT(catpt_index_image(paddr, fw, size) == STATUS_INVALID_PARAMETER);
+	ASSERT(!this->fw_manifest);
+
+	this->fw_manifest = saved;
+	ExFreePoolWithTag(image, CSAUDIOCATPTSST_POOLTAG);
+}
+#endif
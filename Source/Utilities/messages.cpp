@@ -23,6 +23,7 @@ struct catpt_alloc_stream_input {
 NTSTATUS CCsAudioCatptSSTHW::ipc_alloc_stream(
 	enum catpt_path_id path_id,
 	enum catpt_stream_type type,
+	enum catpt_format_id format_id,
 	struct catpt_audio_format* afmt,
 	struct catpt_ring_info* rinfo,
 	UINT8 num_modules,
@@ -50,7 +51,7 @@ NTSTATUS CCsAudioCatptSSTHW::ipc_alloc_stream(
 	RtlZeroMemory(&input, sizeof(input));
 	input.path_id = path_id;
 	input.stream_type = type;
-	input.format_id = CATPT_FORMAT_PCM;
+	input.format_id = format_id;
 	input.input_format = *afmt;
 	input.ring_info = *rinfo;
 	input.num_entries = num_modules;
@@ -99,6 +100,28 @@ NTSTATUS CCsAudioCatptSSTHW::ipc_free_stream(UINT8 stream_hw_id)
 	return status;
 }
 
+NTSTATUS CCsAudioCatptSSTHW::ipc_enter_dxstate(enum catpt_dx_state state,
+	struct catpt_dx_context* context)
+{
+	union catpt_global_msg msg = CATPT_GLOBAL_MSG(ENTER_DX_STATE);
+	struct catpt_ipc_msg request, reply;
+	NTSTATUS status;
+
+	request.header = msg.val;
+	request.size = sizeof(state);
+	request.data = &state;
+
+	reply.size = sizeof(*context);
+	reply.data = context;
+
+	status = ipc_send_msg(request, &reply, CATPT_IPC_TIMEOUT_MS);
+	if (!NT_SUCCESS(status)) {
+		CatPtPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "enter dx state failed: %d\n", status);
+	}
+
+	return status;
+}
+
 NTSTATUS CCsAudioCatptSSTHW::ipc_set_device_format(struct catpt_ssp_device_format* devfmt)
 {
 	union catpt_global_msg msg = CATPT_GLOBAL_MSG(SET_DEVICE_FORMATS);
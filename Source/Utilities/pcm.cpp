@@ -9,9 +9,15 @@ struct catpt_stream_template {
 	enum catpt_stream_type type;
 	UINT32 persistent_size;
 	UINT8 num_entries;
-	struct catpt_module_entry entries[1];
+	struct catpt_module_entry entries[CATPT_STREAM_MAX_MODULES];
 };
 
+/* rate the SSP0 system/capture pins run at; anything else needs SRC */
+#define CATPT_SSP0_RATE 48000
+
+#define DSP_VOLUME_MAX		INT32_MAX /* 0db */
+#define DSP_VOLUME_STEP_MAX	30
+
 static struct catpt_stream_template system_pb = {
 	.path_id = CATPT_PATH_SSP0_OUT,
 	.type = CATPT_STRM_TYPE_SYSTEM,
@@ -26,6 +32,14 @@ static struct catpt_stream_template system_cp = {
 	.entries = {{ CATPT_MODID_PCM_CAPTURE, 0 }},
 };
 
+/* second reader of the SSP0 capture, fed by the firmware's duplicated path */
+static struct catpt_stream_template system_cp_dup = {
+	.path_id = CATPT_PATH_SSP0_IN_DUP,
+	.type = CATPT_STRM_TYPE_CAPTURE,
+	.num_entries = 1,
+	.entries = {{ CATPT_MODID_PCM_CAPTURE, 0 }},
+};
+
 static struct catpt_stream_template offload_pb = {
 	.path_id = CATPT_PATH_SSP0_OUT,
 	.type = CATPT_STRM_TYPE_RENDER,
@@ -61,18 +75,49 @@ static struct catpt_stream_template* catpt_topology[] = {
 	/*[CATPT_STRM_TYPE_LOOPBACK] =*/ &loopback_cp,
 	/*[CATPT_STRM_TYPE_BLUETOOTH_RENDER] =*/ &bluetooth_pb,
 	/*[CATPT_STRM_TYPE_BLUETOOTH_CAPTURE] =*/ &bluetooth_cp,
+	/* not indexed by type, listed so it gets armed */
+	&system_cp_dup,
+};
+
+static enum catpt_module_id catpt_runtime_modules[] = {
+	CATPT_MODID_SRC,
+	CATPT_MODID_MP3,
+	CATPT_MODID_AAC_5_1,
+	CATPT_MODID_AAC_2_0,
 };
 
+/*
+ * Modules the firmware loader copies at boot: the base firmware and
+ * whatever the templates reference. Everything else is left for
+ * catpt_load_deferred() once a stream asks for it.
+ */
+bool CCsAudioCatptSSTHW::catpt_module_eager(UINT16 module_id)
+{
+	int i, j;
+
+	if (module_id == CATPT_MODID_BASE_FW)
+		return true;
+
+	for (i = 0; i < sizeof(catpt_topology) / sizeof(struct catpt_stream_template*); i++) {
+		for (j = 0; j < catpt_topology[i]->num_entries; j++) {
+			if (catpt_topology[i]->entries[j].module_id == module_id)
+				return true;
+		}
+	}
+
+	return false;
+}
+
 NTSTATUS CCsAudioCatptSSTHW::catpt_arm_stream_templates()
 {
 	PRESOURCE res;
+	struct catpt_module_type* type;
 	UINT32 scratch_size = 0;
 	int i, j;
 
 	for (i = 0; i < sizeof(catpt_topology) / sizeof(struct catpt_stream_template *); i++) {
 		struct catpt_stream_template* templ;
 		struct catpt_module_entry* entry;
-		struct catpt_module_type* type;
 
 		templ = catpt_topology[i];
 		templ->persistent_size = 0;
@@ -91,6 +136,13 @@ NTSTATUS CCsAudioCatptSSTHW::catpt_arm_stream_templates()
 		}
 	}
 
+	/* not part of any template but may be chained, and loaded, at runtime */
+	for (i = 0; i < sizeof(catpt_runtime_modules) / sizeof(catpt_runtime_modules[0]); i++) {
+		type = &this->modules[catpt_runtime_modules[i]];
+		if (type->image_offset && type->scratch_size > scratch_size)
+			scratch_size = type->scratch_size;
+	}
+
 	if (scratch_size) {
 		/* allocate single scratch area for all modules */
 		res = catpt_request_region(&this->dram, scratch_size);
@@ -104,33 +156,527 @@ NTSTATUS CCsAudioCatptSSTHW::catpt_arm_stream_templates()
 
 struct catpt_stream* CCsAudioCatptSSTHW::catpt_stream_find(UINT8 stream_hw_id)
 {
-	if (this->outStream.info.stream_hw_id == stream_hw_id) {
-		return &this->outStream;
-	}
-	if (this->inStream.info.stream_hw_id == stream_hw_id) {
-		return &this->inStream;
+	int i;
+
+	for (i = 0; i < eMaxDeviceType; i++) {
+		if (this->streams[i].allocated &&
+			this->streams[i].info.stream_hw_id == stream_hw_id)
+			return &this->streams[i];
 	}
 	return NULL;
 }
 
-NTSTATUS CCsAudioCatptSSTHW::sst_program_dma(eDeviceType deviceType, UINT32 byteCount, PMDL mdl, IPortWaveRTStream* waveStream) {
-#if USESSTHW
-	NTSTATUS status;
+struct catpt_stream* CCsAudioCatptSSTHW::catpt_stream_get(eDeviceType deviceType)
+{
+	if (deviceType < eSpeakerDevice || deviceType >= eMaxDeviceType)
+		return NULL;
+	return &this->streams[deviceType];
+}
 
-	catpt_stream* stream;
+static UINT32 catpt_get_channel_map(enum catpt_channel_config config)
+{
+	switch (config) {
+	case CATPT_CHANNEL_CONFIG_MONO:
+		return GENMASK(31, 4) | CATPT_CHANNEL_CENTER;
+
+	case CATPT_CHANNEL_CONFIG_STEREO:
+		return GENMASK(31, 8) | CATPT_CHANNEL_LEFT
+			| (CATPT_CHANNEL_RIGHT << 4);
+
+	case CATPT_CHANNEL_CONFIG_2_POINT_1:
+		return GENMASK(31, 12) | CATPT_CHANNEL_LEFT
+			| (CATPT_CHANNEL_RIGHT << 4)
+			| (CATPT_CHANNEL_LFE << 8);
+
+	case CATPT_CHANNEL_CONFIG_3_POINT_0:
+		return GENMASK(31, 12) | CATPT_CHANNEL_LEFT
+			| (CATPT_CHANNEL_CENTER << 4)
+			| (CATPT_CHANNEL_RIGHT << 8);
+
+	case CATPT_CHANNEL_CONFIG_3_POINT_1:
+		return GENMASK(31, 16) | CATPT_CHANNEL_LEFT
+			| (CATPT_CHANNEL_CENTER << 4)
+			| (CATPT_CHANNEL_RIGHT << 8)
+			| (CATPT_CHANNEL_LFE << 12);
+
+	case CATPT_CHANNEL_CONFIG_QUATRO:
+		return GENMASK(31, 16) | CATPT_CHANNEL_LEFT
+			| (CATPT_CHANNEL_RIGHT << 4)
+			| (CATPT_CHANNEL_LEFT_SURROUND << 8)
+			| (CATPT_CHANNEL_RIGHT_SURROUND << 12);
+
+	case CATPT_CHANNEL_CONFIG_4_POINT_0:
+		return GENMASK(31, 16) | CATPT_CHANNEL_LEFT
+			| (CATPT_CHANNEL_CENTER << 4)
+			| (CATPT_CHANNEL_RIGHT << 8)
+			| (CATPT_CHANNEL_CENTER_SURROUND << 12);
+
+	case CATPT_CHANNEL_CONFIG_5_POINT_0:
+		return GENMASK(31, 20) | CATPT_CHANNEL_LEFT
+			| (CATPT_CHANNEL_CENTER << 4)
+			| (CATPT_CHANNEL_RIGHT << 8)
+			| (CATPT_CHANNEL_LEFT_SURROUND << 12)
+			| (CATPT_CHANNEL_RIGHT_SURROUND << 16);
+
+	case CATPT_CHANNEL_CONFIG_5_POINT_1:
+		return GENMASK(31, 24) | CATPT_CHANNEL_CENTER
+			| (CATPT_CHANNEL_LEFT << 4)
+			| (CATPT_CHANNEL_RIGHT << 8)
+			| (CATPT_CHANNEL_LEFT_SURROUND << 12)
+			| (CATPT_CHANNEL_RIGHT_SURROUND << 16)
+			| (CATPT_CHANNEL_LFE << 20);
+
+	case CATPT_CHANNEL_CONFIG_DUAL_MONO:
+		return GENMASK(31, 8) | CATPT_CHANNEL_LEFT
+			| (CATPT_CHANNEL_LEFT << 4);
 
-	CatPtPrint(DEBUG_LEVEL_VERBOSE, DBG_IOCTL, "Programming stream %d\n", deviceType);
+	default:
+		return MAXUINT32;
+	}
+}
+
+static enum catpt_channel_config catpt_get_channel_config(UINT32 num_channels)
+{
+	switch (num_channels) {
+	case 6: return CATPT_CHANNEL_CONFIG_5_POINT_1;
+	case 5: return CATPT_CHANNEL_CONFIG_5_POINT_0;
+	case 4: return CATPT_CHANNEL_CONFIG_QUATRO;
+	case 3: return CATPT_CHANNEL_CONFIG_2_POINT_1;
+	case 1: return CATPT_CHANNEL_CONFIG_MONO;
+	case 2:
+	default: return CATPT_CHANNEL_CONFIG_STEREO;
+	}
+}
+
+/*
+ * Copy the negotiated format into the stream so it outlives the pin and
+ * can be replayed on resume. Plain WAVEFORMATEX carries no valid bits.
+ */
+static void catpt_stream_set_format(struct catpt_stream* stream, PWAVEFORMATEXTENSIBLE format)
+{
+	if (format == &stream->format)
+		return;
+
+	RtlZeroMemory(&stream->format, sizeof(stream->format));
+	if (format->Format.wFormatTag == WAVE_FORMAT_EXTENSIBLE &&
+		format->Format.cbSize >= sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)) {
+		RtlCopyMemory(&stream->format, format, sizeof(stream->format));
+	}
+	else {
+		RtlCopyMemory(&stream->format.Format, &format->Format, sizeof(WAVEFORMATEX));
+		stream->format.Samples.wValidBitsPerSample = format->Format.wBitsPerSample;
+	}
+}
+
+static enum catpt_format_id catpt_get_format_id(PWAVEFORMATEX format)
+{
+	switch (format->wFormatTag) {
+	case WAVE_FORMAT_MPEGLAYER3:
+		return CATPT_FORMAT_MP3;
+	case WAVE_FORMAT_MPEG_HEAAC:
+		return CATPT_FORMAT_AAC;
+	default:
+		return CATPT_FORMAT_PCM;
+	}
+}
 
+static void catpt_get_audio_format(PWAVEFORMATEXTENSIBLE format, struct catpt_audio_format* afmt)
+{
+	RtlZeroMemory(afmt, sizeof(*afmt));
+	afmt->sample_rate = format->Format.nSamplesPerSec;
+	if (catpt_get_format_id(&format->Format) != CATPT_FORMAT_PCM) {
+		/* compressed input, describe what the decoder hands to the mixer */
+		afmt->bit_depth = 16;
+		afmt->valid_bit_depth = 16;
+	}
+	else {
+		afmt->bit_depth = format->Format.wBitsPerSample;
+		afmt->valid_bit_depth = (UINT8)format->Samples.wValidBitsPerSample;
+	}
+	afmt->num_channels = (UINT8)format->Format.nChannels;
+	afmt->channel_config = catpt_get_channel_config(afmt->num_channels);
+	afmt->channel_map = catpt_get_channel_map(afmt->channel_config);
+	afmt->interleaving = CATPT_INTERLEAVING_PER_CHANNEL;
+}
+
+static struct catpt_stream_template* catpt_stream_template(eDeviceType deviceType, PWAVEFORMATEX format)
+{
 	switch (deviceType) {
 	case eSpeakerDevice:
-		stream = &this->outStream;
-		stream->templ = &system_pb;
-		break;
+		/* any rate, catpt_stream_chain() adds SRC when it is not 48kHz */
+		return &system_pb;
 	case eMicJackDevice:
-		stream = &this->inStream;
-		stream->templ = &system_cp;
+		return &system_cp;
+	case eMicJackDupDevice:
+		return &system_cp_dup;
+	case eBthHfpSpeakerDevice:
+		return &bluetooth_pb;
+	case eBthHfpMicDevice:
+		return &bluetooth_cp;
+	case eSpeakerOffloadDevice:
+		return &offload_pb;
+	default:
+		return NULL;
+	}
+}
+
+/* Bluetooth streams, SSP1 is clocked by the BT module */
+static BOOL catpt_template_on_ssp1(struct catpt_stream_template* templ)
+{
+	return templ->path_id == CATPT_PATH_SSP1_OUT || templ->path_id == CATPT_PATH_SSP1_IN;
+}
+
+/*
+ * Module ids a stream needs for the given format. Compressed streams get
+ * their decoder in front of the offload PCM module. System and capture
+ * modules only run at the SSP rate, so append SRC when the client rate
+ * differs and let the DSP convert instead of the audio engine.
+ */
+static UINT8 catpt_stream_chain(struct catpt_stream_template* templ, PWAVEFORMATEX format,
+	struct catpt_module_entry* entries)
+{
+	UINT8 count = 0;
+	int i;
+
+	switch (catpt_get_format_id(format)) {
+	case CATPT_FORMAT_MP3:
+		entries[count++].module_id = CATPT_MODID_MP3;
+		break;
+	case CATPT_FORMAT_AAC:
+		if (format->nChannels > 2)
+			entries[count++].module_id = CATPT_MODID_AAC_5_1;
+		else
+			entries[count++].module_id = CATPT_MODID_AAC_2_0;
 		break;
 	default:
+		break;
+	}
+
+	for (i = 0; i < templ->num_entries; i++)
+		entries[count++] = templ->entries[i];
+
+	if (format->nSamplesPerSec != CATPT_SSP0_RATE &&
+		!catpt_template_on_ssp1(templ) &&
+		templ->entries[0].module_id != CATPT_MODID_PCM)
+		entries[count++].module_id = CATPT_MODID_SRC;
+
+	return count;
+}
+
+/* whether the resident image carries every module of the chain */
+static BOOL catpt_chain_in_image(struct catpt_fw_manifest* man,
+	struct catpt_module_entry* entries, UINT8 count)
+{
+	if (!man)
+		return FALSE;
+
+	for (UINT8 i = 0; i < count; i++) {
+		if (!man->modules[entries[i].module_id].image_offset)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+#if DBG
+/* what sst_format_supported() must answer, against a full and a stock image */
+static const struct catpt_chain_case {
+	eDeviceType device;
+	WORD tag;
+	WORD channels;
+	DWORD rate;
+	UINT8 count;
+	UINT32 ids[CATPT_STREAM_MAX_MODULES];
+	BOOL stock;
+} catpt_chain_cases[] = {
+	{ eSpeakerDevice, WAVE_FORMAT_PCM, 2, 48000, 1, { CATPT_MODID_PCM_SYSTEM }, TRUE },
+	{ eSpeakerDevice, WAVE_FORMAT_PCM, 2, 44100, 2, { CATPT_MODID_PCM_SYSTEM, CATPT_MODID_SRC }, FALSE },
+	{ eSpeakerDevice, WAVE_FORMAT_PCM, 2, 96000, 2, { CATPT_MODID_PCM_SYSTEM, CATPT_MODID_SRC }, FALSE },
+	{ eMicJackDevice, WAVE_FORMAT_PCM, 2, 48000, 1, { CATPT_MODID_PCM_CAPTURE }, TRUE },
+	{ eMicJackDevice, WAVE_FORMAT_PCM, 2, 44100, 2, { CATPT_MODID_PCM_CAPTURE, CATPT_MODID_SRC }, FALSE },
+	{ eBthHfpMicDevice, WAVE_FORMAT_PCM, 1, 16000, 1, { CATPT_MODID_BLUETOOTH_CAPTURE }, TRUE },
+	{ eSpeakerOffloadDevice, WAVE_FORMAT_MPEGLAYER3, 2, 48000, 2, { CATPT_MODID_MP3, CATPT_MODID_PCM }, FALSE },
+	{ eSpeakerOffloadDevice, WAVE_FORMAT_MPEG_HEAAC, 2, 44100, 2, { CATPT_MODID_AAC_2_0, CATPT_MODID_PCM }, FALSE },
+	{ eSpeakerOffloadDevice, WAVE_FORMAT_MPEG_HEAAC, 6, 48000, 2, { CATPT_MODID_AAC_5_1, CATPT_MODID_PCM }, TRUE },
+};
+
+/*
+ * Runs the chain builder against simulated manifests, no DSP involved: one
+ * with every module, one shaped like the stock IntcSST2.bin, which ships
+ * neither SRC nor the MP3 and AAC 2.0 decoders.
+ */
+void CCsAudioCatptSSTHW::catpt_check_chains()
+{
+	struct catpt_module_entry entries[CATPT_STREAM_MAX_MODULES];
+	struct catpt_fw_manifest full, stock;
+
+	RtlZeroMemory(&full, sizeof(full));
+	/* any non-zero offset counts as present */
+	for (UINT32 i = 0; i < CATPT_MODULE_COUNT; i++)
+		full.modules[i].image_offset = 1;
+	stock = full;
+	stock.modules[CATPT_MODID_SRC].image_offset = 0;
+	stock.modules[CATPT_MODID_MP3].image_offset = 0;
+	stock.modules[CATPT_MODID_AAC_2_0].image_offset = 0;
+
+	for (int i = 0; i < sizeof(catpt_chain_cases) / sizeof(catpt_chain_cases[0]); i++) {
+		const struct catpt_chain_case* c = &catpt_chain_cases[i];
+		struct catpt_stream_template* templ;
+		WAVEFORMATEX format;
+		UINT8 count;
+
+		RtlZeroMemory(&format, sizeof(format));
+		format.wFormatTag = c->tag;
+		format.nChannels = c->channels;
+		format.nSamplesPerSec = c->rate;
+
+		templ = catpt_stream_template(c->device, &format);
+		ASSERT(templ);
+		count = catpt_stream_chain(templ, &format, entries);
+		ASSERT(count == c->count);
+		for (UINT8 j = 0; j < count; j++)
+			ASSERT(entries[j].module_id == c->ids[j]);
+
+		ASSERT(catpt_chain_in_image(&full, entries, count));
+		ASSERT(catpt_chain_in_image(&stock, entries, count) == c->stock);
+	}
+}
+#endif
+
+NTSTATUS CCsAudioCatptSSTHW::catpt_stream_compose(struct catpt_stream* stream)
+{
+	struct catpt_module_type* type;
+	int i;
+
+	stream->num_entries = catpt_stream_chain(stream->templ, &stream->format.Format, stream->entries);
+	stream->persistent_size = 0;
+
+	for (i = 0; i < stream->num_entries; i++) {
+		/* sst_format_supported() already refused chains the image lacks */
+		type = &this->modules[stream->entries[i].module_id];
+		if (!type->loaded) {
+			NTSTATUS status = catpt_load_deferred(stream->entries[i].module_id);
+			if (!NT_SUCCESS(status)) {
+				CatPtPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "module %d not loaded: 0x%x\n",
+					stream->entries[i].module_id, status);
+				return status;
+			}
+		}
+
+		stream->entries[i].entry_point = type->entry_point;
+		stream->persistent_size += type->persistent_size;
+	}
+
+	return STATUS_SUCCESS;
+}
+
+/*
+ * Format negotiation asks here before a stream is ever created, so a
+ * format whose chain needs a module the image does not ship (SRC for
+ * 44.1kHz playback or capture, a decoder for compressed playback) is
+ * refused up front instead of failing in sst_program_dma. So is every
+ * Bluetooth format while SSP1 is not configured.
+ */
+BOOL CCsAudioCatptSSTHW::sst_format_supported(eDeviceType deviceType, PWAVEFORMATEX format) {
+#if USESSTHW
+	struct catpt_module_entry entries[CATPT_STREAM_MAX_MODULES];
+	struct catpt_stream_template* templ;
+
+	templ = catpt_stream_template(deviceType, format);
+	if (!templ)
+		return FALSE;
+	if (catpt_template_on_ssp1(templ) && !this->ssp1_ready)
+		return FALSE;
+
+	return catpt_chain_in_image(this->fw_manifest, entries,
+		catpt_stream_chain(templ, format, entries));
+#else
+	UNREFERENCED_PARAMETER(deviceType);
+	UNREFERENCED_PARAMETER(format);
+	return TRUE;
+#endif
+}
+
+/* PFN of page i, as catpt_pack_page_table() asks for it */
+typedef UINT64 CATPT_PAGE_PFN(PVOID context, ULONG i);
+
+struct catpt_ring_pages {
+	IPortWaveRTStream* waveStream;
+	PMDL mdl;
+};
+
+static UINT64 catpt_ring_pfn(PVOID context, ULONG i)
+{
+	struct catpt_ring_pages* ring = (struct catpt_ring_pages*)context;
+
+	return (UINT64)(ring->waveStream->GetPhysicalPageAddress(ring->mdl, i).QuadPart >> PAGE_SHIFT);
+}
+
+/*
+ * PFNs are 20 bits wide and stored back to back, so two of them fill five
+ * bytes. Build each pair in a register and store it whole rather than or-ing
+ * into overlapping words; only an odd last entry is written on its own.
+ */
+static void catpt_pack_page_table(UINT8* table, CATPT_PAGE_PFN* pfn, PVOID context, ULONG count)
+{
+	UINT64 pair;
+	UINT64 lo, hi;
+	ULONG i;
+
+	for (i = 0; i + 1 < count; i += 2) {
+		lo = pfn(context, i) & 0xFFFFF;
+		hi = pfn(context, i + 1) & 0xFFFFF;
+		pair = lo | (hi << 20);
+		RtlCopyMemory(table + (i >> 1) * 5, &pair, 5);
+	}
+
+	if (count & 1) {
+		pair = pfn(context, count - 1) & 0xFFFFF;
+		RtlCopyMemory(table + (count >> 1) * 5, &pair, 3);
+	}
+}
+
+/*
+ * The table only depends on the ring's pages, so build it once per MDL and
+ * reuse it when the same buffer is programmed again on RUN or on resume.
+ */
+static NTSTATUS catpt_stream_page_table(struct catpt_stream* stream, DmaPool* pool, IPortWaveRTStream* waveStream, PMDL mdl, ULONG pageCount)
+{
+	if (stream->pageTable && stream->pageTableMdl == mdl &&
+		stream->pageTableCount == pageCount)
+		return STATUS_SUCCESS;
+
+	if (!stream->pageTable) {
+		stream->pageTable = pool->alloc_block(&stream->pageTableAddr);
+		if (!stream->pageTable)
+			return STATUS_NO_MEMORY;
+	}
+
+	struct catpt_ring_pages ring = { waveStream, mdl };
+
+	RtlZeroMemory(stream->pageTable, PAGE_SIZE);
+	catpt_pack_page_table((UINT8*)stream->pageTable, catpt_ring_pfn, &ring, pageCount);
+
+	stream->firstPagePfn = (UINT32)(waveStream->GetPhysicalPageAddress(mdl, 0).QuadPart >> PAGE_SHIFT);
+	stream->pageTableMdl = mdl;
+	stream->pageTableCount = pageCount;
+	return STATUS_SUCCESS;
+}
+
+#if DBG
+static UINT64 catpt_test_pfn(PVOID context, ULONG i)
+{
+	return ((const UINT64*)context)[i];
+}
+
+/* page i at PFN i, with a bit above the 20 the table keeps */
+static UINT64 catpt_index_pfn(PVOID context, ULONG i)
+{
+	UNREFERENCED_PARAMETER(context);
+	return 0x100000 | i;
+}
+
+/* entry i of a packed table, 20 bits at bit 20 * i */
+static UINT32 catpt_page_table_entry(const UINT8* table, ULONG i)
+{
+	ULONG bit = i * 20;
+	UINT32 v = table[bit / 8] | (table[bit / 8 + 1] << 8) | (table[bit / 8 + 2] << 16);
+
+	return (v >> (bit % 8)) & 0xFFFFF;
+}
+
+/*
+ * A pair packs into five bytes and an odd last entry into three, nothing
+ * past them is touched, PFN bits above 20 are dropped, and a table of
+ * CATPT_PAGE_TABLE_MAX_PAGES entries fits its page.
+ */
+void CCsAudioCatptSSTHW::catpt_check_page_table()
+{
+	static const UINT64 pfns[3] = { 0x12345, 0xABCDE, 0x7F0F0F };
+	static const UINT8 packed[8] = { 0x45, 0x23, 0xE1, 0xCD, 0xAB, 0x0F, 0x0F, 0x0F };
+	const ULONG used = (CATPT_PAGE_TABLE_MAX_PAGES * 20 + 7) / 8;
+	UINT8* table;
+
+	ASSERT(used <= PAGE_SIZE);
+
+	table = (UINT8*)ExAllocatePoolZero(NonPagedPool, PAGE_SIZE, CSAUDIOCATPTSST_POOLTAG);
+	if (!table)
+		return;
+
+	RtlFillMemory(table, PAGE_SIZE, 0xEE);
+	catpt_pack_page_table(table, catpt_test_pfn, (PVOID)pfns, 2);
+	ASSERT(RtlCompareMemory(table, packed, 5) == 5 && table[5] == 0xEE);
+
+	RtlFillMemory(table, PAGE_SIZE, 0xEE);
+	catpt_pack_page_table(table, catpt_test_pfn, (PVOID)pfns, 3);
+	ASSERT(RtlCompareMemory(table, packed, 8) == 8 && table[8] == 0xEE);
+
+	RtlFillMemory(table, PAGE_SIZE, 0xEE);
+	catpt_pack_page_table(table, catpt_index_pfn, NULL, CATPT_PAGE_TABLE_MAX_PAGES);
+	for (ULONG i = 0; i < CATPT_PAGE_TABLE_MAX_PAGES; i++)
+		ASSERT(catpt_page_table_entry(table, i) == i);
+	if (used < PAGE_SIZE)
+		ASSERT(table[used] == 0xEE);
+
+	ExFreePoolWithTag(table, CSAUDIOCATPTSST_POOLTAG);
+}
+
+/*
+ * The WaveRT stream holds the offload write position until RUN and replays
+ * it once the stream is allocated. Before that nothing reaches the DSP, the
+ * replay sends one SET_WRITE_POSITION stage message for the stream's hw id
+ * with the position and both flags clear, and system streams never send one.
+ */
+void CCsAudioCatptSSTHW::catpt_check_write_position()
+{
+	union catpt_stream_msg msg = CATPT_STAGE_MSG(SET_WRITE_POSITION);
+	struct catpt_stream saved[2];
+	struct catpt_ipc_capture cap;
+	struct catpt_stream* offload = &this->streams[eSpeakerOffloadDevice];
+	struct catpt_stream* system = &this->streams[eSpeakerDevice];
+	UINT32 pos;
+
+	saved[0] = *offload;
+	saved[1] = *system;
+	RtlZeroMemory(&cap, sizeof(cap));
+	this->ipc_capture = &cap;
+
+	/* SetCurrentWritePosition before RUN */
+	offload->allocated = FALSE;
+	ASSERT(sst_set_write_position(eSpeakerOffloadDevice, 0x1000) == STATUS_INVALID_DEVICE_STATE);
+	ASSERT(cap.count == 0);
+
+	/* replay on RUN */
+	offload->templ = &offload_pb;
+	offload->info.stream_hw_id = 5;
+	offload->allocated = TRUE;
+	ASSERT(NT_SUCCESS(sst_set_write_position(eSpeakerOffloadDevice, 0x1000)));
+	msg.stream_hw_id = 5;
+	RtlCopyMemory(&pos, cap.data, sizeof(pos));
+	ASSERT(cap.count == 1 && cap.header == msg.val);
+	ASSERT(cap.size == sizeof(pos) + 2 && pos == 0x1000);
+	ASSERT(!cap.data[4] && !cap.data[5]);
+
+	system->templ = &system_pb;
+	system->allocated = TRUE;
+	ASSERT(sst_set_write_position(eSpeakerDevice, 0x1000) == STATUS_NOT_SUPPORTED);
+	ASSERT(cap.count == 1);
+
+	this->ipc_capture = NULL;
+	*offload = saved[0];
+	*system = saved[1];
+}
+#endif
+
+NTSTATUS CCsAudioCatptSSTHW::sst_program_dma(eDeviceType deviceType, UINT32 byteCount, PMDL mdl, IPortWaveRTStream* waveStream, PWAVEFORMATEXTENSIBLE format) {
+#if USESSTHW
+	NTSTATUS status;
+
+	catpt_stream* stream;
+
+	CatPtPrint(DEBUG_LEVEL_VERBOSE, DBG_IOCTL, "Programming stream %d\n", deviceType);
+
+	stream = catpt_stream_get(deviceType);
+	if (!stream) {
 		CatPtPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "Unknown device type");
 		return STATUS_INVALID_PARAMETER;
 	}
@@ -140,76 +686,61 @@ NTSTATUS CCsAudioCatptSSTHW::sst_program_dma(eDeviceType deviceType, UINT32 byte
 		return STATUS_INVALID_PARAMETER;
 	}
 
-	LONG volMax[CATPT_CHANNELS_MAX] = { 0, 0, 0, 0 };
+	catpt_stream_set_format(stream, format);
 
-	int pageCount = waveStream->GetPhysicalPagesCount(mdl);
-	if (pageCount < 1) {
-		return STATUS_NO_MEMORY;
+	stream->templ = catpt_stream_template(deviceType, &stream->format.Format);
+	if (stream->templ && catpt_template_on_ssp1(stream->templ) && !this->ssp1_ready) {
+		DPF(D_ERROR, "SSP1 is not configured, no Bluetooth stream\n");
+		return STATUS_DEVICE_NOT_READY;
 	}
 
-	PHYSICAL_ADDRESS highAddr;
-	highAddr.QuadPart = MAXULONG;
+	LONG volMax[CATPT_CHANNELS_MAX] = { 0, 0, 0, 0 };
 
-	UINT8* pageTable = (UINT8*)stream->pageTable;
-	if (!pageTable) {
-		stream->pageTable = MmAllocateContiguousMemory(PAGE_SIZE, highAddr);
-		pageTable = (UINT8*)stream->pageTable;
-	}
-	if (!pageTable) {
+	ULONG pageCount = waveStream->GetPhysicalPagesCount(mdl);
+	if (pageCount < 1) {
 		return STATUS_NO_MEMORY;
 	}
+	if (pageCount > CATPT_PAGE_TABLE_MAX_PAGES) {
+		DPF(D_ERROR, "ring of %lu pages exceeds page table limit of %lu\n",
+			pageCount, (ULONG)CATPT_PAGE_TABLE_MAX_PAGES);
+		return STATUS_INVALID_BUFFER_SIZE;
+	}
 
-	RtlZeroMemory(pageTable, PAGE_SIZE);
-	for (int i = 0; i < pageCount; i++) {
-		PHYSICAL_ADDRESS address = waveStream->GetPhysicalPageAddress(mdl, i);
-		LONGLONG addrVal = address.QuadPart;
-
-		UINT32 pfn = (UINT32)(addrVal >> 12);
-		UINT32 offset = ((i << 2) + i) >> 1;
-
-		UINT32* page_table = (UINT32*)(pageTable + offset);
-		if (i & 1)
-			*page_table |= (pfn << 4);
-		else
-			*page_table |= pfn;
+	status = catpt_stream_compose(stream);
+	if (!NT_SUCCESS(status)) {
+		return status;
 	}
 
-	PHYSICAL_ADDRESS pageTableAddr = MmGetPhysicalAddress(pageTable);
+	status = catpt_stream_page_table(stream, this->dmapool, waveStream, mdl, pageCount);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
 
 	if (!stream->persistent) {
-		stream->persistent = catpt_request_region(&this->dram, stream->templ->persistent_size);
+		stream->persistent = catpt_request_region(&this->dram, stream->persistent_size);
 		dsp_update_srampge(&this->dram, this->spec->dram_mask);
 	}
 
 	struct catpt_audio_format afmt;
-	RtlZeroMemory(&afmt, sizeof(afmt));
-	afmt.sample_rate = 48000;
-	afmt.bit_depth = 16;
-	afmt.valid_bit_depth = 16;
-	afmt.num_channels = 2;
-	afmt.channel_config = CATPT_CHANNEL_CONFIG_STEREO;
-	afmt.channel_map = GENMASK(31, 8) | CATPT_CHANNEL_LEFT
-		| (CATPT_CHANNEL_RIGHT << 4);
-	afmt.interleaving = CATPT_INTERLEAVING_PER_CHANNEL;
-
-	PHYSICAL_ADDRESS firstPage = waveStream->GetPhysicalPageAddress(mdl, 0);
+	catpt_get_audio_format(&stream->format, &afmt);
 
 	struct catpt_ring_info rinfo;
 	RtlZeroMemory(&rinfo, sizeof(rinfo));
-	rinfo.page_table_addr = pageTableAddr.LowPart; //TODO: figure out page table addr
+	rinfo.page_table_addr = stream->pageTableAddr.LowPart;
 	rinfo.num_pages = pageCount;
 	rinfo.size = byteCount;
 	rinfo.offset = 0;
-	rinfo.ring_first_page_pfn = (firstPage.LowPart >> 12);
+	rinfo.ring_first_page_pfn = stream->firstPagePfn;
 
 	CatPtPrint(DEBUG_LEVEL_VERBOSE, DBG_IOCTL, "Buffer Size: %d, Pages: %d\n", rinfo.size, rinfo.num_pages);
 
 	status = ipc_alloc_stream(
 		stream->templ->path_id,
 		stream->templ->type,
+		catpt_get_format_id(&stream->format.Format),
 		&afmt, &rinfo,
-		stream->templ->num_entries,
-		stream->templ->entries,
+		stream->num_entries,
+		stream->entries,
 		stream->persistent,
 		&stream->info
 	);
@@ -227,21 +758,30 @@ NTSTATUS CCsAudioCatptSSTHW::sst_program_dma(eDeviceType deviceType, UINT32 byte
 	stream->allocated = true;
 
 	NTSTATUS volStatus;
-	volStatus = set_dsp_vol((UINT8)this->outStream.info.stream_hw_id, volMax);
+	volStatus = set_dsp_vol((UINT8)this->streams[eSpeakerDevice].info.stream_hw_id, volMax);
 	if (!NT_SUCCESS(volStatus)) {
 		CatPtPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "Failed to set stream volume 0x%x\n", volStatus);
 		//Don't fail here
 	}
+
+	if (stream->templ->type == CATPT_STRM_TYPE_RENDER) {
+		/* offload streams have their own gain stage, leave it at 0dB */
+		LONG volOffload[CATPT_CHANNELS_MAX] = { DSP_VOLUME_STEP_MAX, DSP_VOLUME_STEP_MAX,
+			DSP_VOLUME_STEP_MAX, DSP_VOLUME_STEP_MAX };
+		volStatus = set_dsp_vol((UINT8)stream->info.stream_hw_id, volOffload);
+		if (!NT_SUCCESS(volStatus)) {
+			CatPtPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "Failed to set offload volume 0x%x\n", volStatus);
+		}
+	}
 #else
 	UNREFERENCED_PARAMETER(deviceType);
 	UNREFERENCED_PARAMETER(stream);
 	UNREFERENCED_PARAMETER(mdl);
+	UNREFERENCED_PARAMETER(format);
 #endif
 	return STATUS_SUCCESS;
 }
 
-#define DSP_VOLUME_MAX		INT32_MAX /* 0db */
-#define DSP_VOLUME_STEP_MAX	30
 static UINT32 ctlvol_to_dspvol(UINT32 value)
 {
 	if (value > DSP_VOLUME_STEP_MAX)
@@ -278,4 +818,45 @@ NTSTATUS CCsAudioCatptSSTHW::set_dsp_vol(UINT8 stream_id, LONG* ctlvol) {
 	}
 
 	return status;
-}
\ No newline at end of file
+}
+
+static bool catpt_stream_is_capture(struct catpt_stream* stream)
+{
+	switch (stream->templ->type) {
+	case CATPT_STRM_TYPE_CAPTURE:
+	case CATPT_STRM_TYPE_LOOPBACK:
+	case CATPT_STRM_TYPE_BLUETOOTH_CAPTURE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Called from the ISR on every period the DSP completes. Only note the
+ * boundary here, the cache maintenance runs from the position query which
+ * is at or below DISPATCH_LEVEL.
+ */
+void CCsAudioCatptSSTHW::stream_update_position(struct catpt_stream* stream, struct catpt_notify_position* pos)
+{
+	if (!stream->allocated)
+		return;
+
+	stream->notifyPos = pos->stream_position;
+	InterlockedExchange(&stream->syncPending, 1);
+}
+
+/*
+ * Keep a cached ring coherent with the DSP's DMA: write back what the
+ * audio engine rendered, drop stale lines before it reads captured data.
+ */
+void CCsAudioCatptSSTHW::stream_sync_buffer(struct catpt_stream* stream)
+{
+	if (!stream->allocated || !stream->pMDL)
+		return;
+
+	if (!InterlockedExchange(&stream->syncPending, 0))
+		return;
+
+	KeFlushIoBuffers(stream->pMDL, catpt_stream_is_capture(stream), TRUE);
+}
@@ -1,6 +1,9 @@
 #include "hw.h"
 #pragma once
 
+/* reserved, but the SRAM behind it may stay power gated */
+#define IORESOURCE_DISABLED	0x10000000
+
 PRESOURCE __request_region(PRESOURCE parent,
 	size_t start, size_t n, int flags);
 void __release_region(PRESOURCE parent, size_t start,